@@ -1,5 +1,8 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
+#include <vector>
+#include <immintrin.h>
 #include "Math.h"
 
 
@@ -82,7 +85,9 @@ namespace dae
 			juist.g = one.g - f0.g;
 			juist.b = one.b - f0.b;
 
-			ColorRGB fresnel = f0 + (juist * std::pow(1.0f - Vector3::Dot(h, v), 5.0f));
+			const float cosine = 1.0f - Vector3::Dot(h, v);
+			const float cosine2 = cosine * cosine;
+			ColorRGB fresnel = f0 + (juist * (cosine2 * cosine2 * cosine));
 
 			return fresnel;
 		}
@@ -96,10 +101,10 @@ namespace dae
 		 */
 		static float NormalDistribution_GGX(const Vector3& n, const Vector3& h, float roughness)
 		{
-			float alpha2 = roughness * roughness;
-			float NdotH2 = float(std::pow(Vector3::Dot(n, h), 2));
-			return float(alpha2 /  (PI * (std::pow(NdotH2 * (alpha2 - 1) + 1, 2))));
-
+			const float alpha2 = roughness * roughness;
+			const float NdotH = Vector3::Dot(n, h);
+			const float distributionTerm = NdotH * NdotH * (alpha2 - 1) + 1;
+			return alpha2 / (PI * distributionTerm * distributionTerm);
 		}
 
 
@@ -133,5 +138,155 @@ namespace dae
 			return G1 * G2;
 		}
 
+		//The variants below take the roughness terms precomputed by the material, the results match the ones above bit for bit
+
+		/**
+		 * \brief NormalDistribution_GGX with alpha2 = roughness * roughness computed up front
+		 */
+		static float NormalDistribution_GGX_Alpha2(const Vector3& n, const Vector3& h, float alpha2)
+		{
+			const float NdotH = Vector3::Dot(n, h);
+			const float distributionTerm = NdotH * NdotH * (alpha2 - 1) + 1;
+			return alpha2 / (PI * distributionTerm * distributionTerm);
+		}
+
+		/**
+		 * \brief GeometryFunction_SchlickGGX with k = (roughness + 1)^2 / 8 computed up front
+		 */
+		static float GeometryFunction_SchlickGGX_K(const Vector3& n, const Vector3& v, float k)
+		{
+			float NdotV = Vector3::Dot(n, v);
+			return NdotV / (NdotV * (1.0f - k) + k);
+		}
+
+		/**
+		 * \brief GeometryFunction_Smith with k = (roughness + 1)^2 / 8 computed up front
+		 */
+		static float GeometryFunction_Smith_K(const Vector3& n, const Vector3& v, const Vector3& l, float k)
+		{
+			return GeometryFunction_SchlickGGX_K(n, v, k) * GeometryFunction_SchlickGGX_K(n, l, k);
+		}
+
+		/**
+		 * \brief Experimental: Cook-Torrence GGX distribution and SchlickGGX geometry term tabulated over (cosine, roughness),
+		 * a bilinear lookup instead of the divisions of the analytic functions above. The gathers cost more than those divisions
+		 * on AVX2 desktop CPUs, so the renderer does not use it and only --benchmark-brdf-tables measures it against them.
+		 * D is indexed by sqrt(1 - |N.H|) and both tables by sqrt(roughness), so the narrow lobes of smooth materials still span several entries
+		 */
+		class CookTorrenceTables final
+		{
+		public:
+			static constexpr uint32_t CosineSize{ 512 };
+			static constexpr uint32_t RoughnessSize{ 64 };
+
+			//First entry of the lower of the two roughness rows and the weight of the upper one, computed once per material
+			struct Row
+			{
+				uint32_t offset{};
+				float weight{};
+			};
+
+			static const CookTorrenceTables& Get()
+			{
+				static const CookTorrenceTables tables{};
+				return tables;
+			}
+
+			static Row GetRow(float roughness)
+			{
+				const float position = sqrtf(std::clamp(roughness, 0.f, 1.f)) * (RoughnessSize - 1);
+				const uint32_t row = std::min(static_cast<uint32_t>(position), RoughnessSize - 2);
+				return { row * CosineSize, position - static_cast<float>(row) };
+			}
+
+			float NormalDistribution(float normalDotHalf, const Row& row) const
+			{
+				return Sample(m_Distribution.data(), sqrtf(std::max(0.f, 1.f - std::abs(normalDotHalf))), row);
+			}
+
+			float GeometrySchlickGGX(float normalDotX, const Row& row) const
+			{
+				return Sample(m_Geometry.data(), normalDotX, row);
+			}
+
+#if defined(__AVX2__)
+			__m256 NormalDistribution(__m256 normalDotHalf, const Row& row) const
+			{
+				const __m256 absoluteDot = _mm256_andnot_ps(_mm256_set1_ps(-0.f), normalDotHalf);
+				return Sample(m_Distribution.data(), _mm256_sqrt_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_set1_ps(1.f), absoluteDot), _mm256_setzero_ps())), row);
+			}
+
+			__m256 GeometrySchlickGGX(__m256 normalDotX, const Row& row) const
+			{
+				return Sample(m_Geometry.data(), normalDotX, row);
+			}
+#endif
+
+		private:
+			std::vector<float> m_Distribution{};
+			std::vector<float> m_Geometry{};
+
+			CookTorrenceTables()
+			{
+				m_Distribution.resize(static_cast<size_t>(CosineSize) * RoughnessSize);
+				m_Geometry.resize(static_cast<size_t>(CosineSize) * RoughnessSize);
+
+				for (uint32_t row{ 0 }; row < RoughnessSize; ++row)
+				{
+					//Roughness 0 is a delta lobe, the first row is clamped to something the analytic D can still evaluate
+					const float rowPosition{ static_cast<float>(row) / (RoughnessSize - 1) };
+					const float roughness{ std::max(rowPosition * rowPosition, 1e-3f) };
+					const float alpha2{ roughness * roughness };
+					const float k{ (roughness + 1.0f) * (roughness + 1.0f) / 8.0f };
+
+					for (uint32_t entry{ 0 }; entry < CosineSize; ++entry)
+					{
+						const float coordinate{ static_cast<float>(entry) / (CosineSize - 1) };
+
+						const float normalDotHalf{ 1.f - coordinate * coordinate };
+						const float distributionTerm{ normalDotHalf * normalDotHalf * (alpha2 - 1) + 1 };
+						m_Distribution[row * CosineSize + entry] = alpha2 / (PI * distributionTerm * distributionTerm);
+
+						m_Geometry[row * CosineSize + entry] = coordinate / (coordinate * (1.0f - k) + k);
+					}
+				}
+			}
+
+			static float Sample(const float* pTable, float coordinate, const Row& row)
+			{
+				const float position = std::clamp(coordinate, 0.f, 1.f) * (CosineSize - 1);
+				const uint32_t entry = std::min(static_cast<uint32_t>(position), CosineSize - 2);
+				const float t = position - static_cast<float>(entry);
+
+				const float* pLow = pTable + row.offset + entry;
+				const float* pHigh = pLow + CosineSize;
+				const float low = pLow[0] + (pLow[1] - pLow[0]) * t;
+				const float high = pHigh[0] + (pHigh[1] - pHigh[0]) * t;
+				return low + (high - low) * row.weight;
+			}
+
+#if defined(__AVX2__)
+			static __m256 Sample(const float* pTable, __m256 coordinate, const Row& row)
+			{
+				//max returns its second operand for NaN, so padding lanes still read entry 0
+				const __m256 clamped = _mm256_min_ps(_mm256_max_ps(coordinate, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+				const __m256 position = _mm256_mul_ps(clamped, _mm256_set1_ps(float(CosineSize - 1)));
+				const __m256i entry = _mm256_min_epi32(_mm256_cvttps_epi32(position), _mm256_set1_epi32(CosineSize - 2));
+				const __m256 t = _mm256_sub_ps(position, _mm256_cvtepi32_ps(entry));
+
+				const float* pLow = pTable + row.offset;
+				const float* pHigh = pLow + CosineSize;
+				const __m256 low0 = _mm256_i32gather_ps(pLow, entry, 4);
+				const __m256 low1 = _mm256_i32gather_ps(pLow + 1, entry, 4);
+				const __m256 high0 = _mm256_i32gather_ps(pHigh, entry, 4);
+				const __m256 high1 = _mm256_i32gather_ps(pHigh + 1, entry, 4);
+
+				const __m256 low = _mm256_add_ps(low0, _mm256_mul_ps(_mm256_sub_ps(low1, low0), t));
+				const __m256 high = _mm256_add_ps(high0, _mm256_mul_ps(_mm256_sub_ps(high1, high0), t));
+				return _mm256_add_ps(low, _mm256_mul_ps(_mm256_sub_ps(high, low), _mm256_set1_ps(row.weight)));
+			}
+#endif
+		};
+
 	}
 }
\ No newline at end of file
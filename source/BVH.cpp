@@ -0,0 +1,648 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <execution>
+#include <future>
+#include <numeric>
+#include <thread>
+
+namespace dae {
+
+	void BVH::Build(const std::vector<AABB>& primitiveBounds, BVHBuildQuality quality)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+
+		nodes.clear();
+		m_LevelNodes.clear();
+		m_LevelOffsets.clear();
+		buildCost = 0.f;
+		buildMilliseconds = 0.f;
+		primitiveIndices.resize(primitiveBounds.size());
+		std::iota(primitiveIndices.begin(), primitiveIndices.end(), 0);
+
+		if (primitiveBounds.empty())
+			return;
+
+		//Enough task levels to hand every core a couple of subtrees
+		const uint32_t threadCount{ std::max(1u, std::thread::hardware_concurrency()) };
+		BuildContext context{ primitiveBounds, {}, 1, static_cast<uint32_t>(std::bit_width(threadCount)) + 1, {} };
+
+		context.centroids.resize(primitiveBounds.size());
+		std::transform(std::execution::par, primitiveBounds.begin(), primitiveBounds.end(), context.centroids.begin(), [](const AABB& bounds)
+			{
+				return bounds.Centroid();
+			});
+
+		//A binary tree over n primitives never has more than 2n - 1 nodes, allocating them up front lets the tasks share the vector
+		nodes.resize(2 * primitiveBounds.size() - 1);
+		nodes[0].leftFirst = 0;
+		nodes[0].primitiveCount = static_cast<uint32_t>(primitiveBounds.size());
+
+		if (quality == BVHBuildQuality::Linear)
+		{
+			SortMortonCodes(context);
+			SubdivideLinear(0, 0, context);
+		}
+		else
+		{
+			Subdivide(0, 0, context);
+		}
+
+		nodes.resize(context.nodeCount);
+		nodes.shrink_to_fit();
+
+		BuildLevels();
+
+		//The linear topology only depends on the codes, its bounds are filled in afterwards
+		if (quality == BVHBuildQuality::Linear)
+			RefitNodes(primitiveBounds);
+
+		buildCost = CalculateCost();
+
+#if defined(WIDE_BVH)
+		CollapseToWide();
+#endif
+#if defined(QUANTIZED_BVH)
+		Quantize();
+#endif
+
+		const std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+		buildMilliseconds = elapsed.count();
+	}
+
+	void BVH::Refit(const std::vector<AABB>& primitiveBounds)
+	{
+		if (nodes.empty())
+			return;
+
+		RefitNodes(primitiveBounds);
+
+#if defined(WIDE_BVH)
+		CollapseToWide();
+#endif
+#if defined(QUANTIZED_BVH)
+		Quantize();
+#endif
+	}
+
+	void BVH::RefitNodes(const std::vector<AABB>& primitiveBounds)
+	{
+		//Children always live one level deeper than their parent, so walking the levels back to front is bottom-up
+		for (size_t level{ m_LevelOffsets.size() - 1 }; level-- > 0;)
+		{
+			const auto levelBegin = m_LevelNodes.begin() + m_LevelOffsets[level];
+			const auto levelEnd = m_LevelNodes.begin() + m_LevelOffsets[level + 1];
+
+			std::for_each(std::execution::par, levelBegin, levelEnd, [&](uint32_t nodeIndex)
+				{
+					BVHNode& node = nodes[nodeIndex];
+					AABB bounds{};
+
+					if (node.IsLeaf())
+					{
+						for (uint32_t i{ node.leftFirst }; i < node.leftFirst + node.primitiveCount; ++i)
+						{
+							bounds.Grow(primitiveBounds[primitiveIndices[i]]);
+						}
+					}
+					else
+					{
+						const BVHNode& left = nodes[node.leftFirst];
+						const BVHNode& right = nodes[node.leftFirst + 1];
+						bounds.min = Vector3::Min(left.minAABB, right.minAABB);
+						bounds.max = Vector3::Max(left.maxAABB, right.maxAABB);
+					}
+
+					node.minAABB = bounds.min;
+					node.maxAABB = bounds.max;
+				});
+		}
+	}
+
+	float BVH::CalculateCost() const
+	{
+		if (nodes.empty())
+			return 0.f;
+
+		const float cost = std::transform_reduce(std::execution::par, nodes.begin(), nodes.end(), 0.f, std::plus<float>{}, [](const BVHNode& node)
+			{
+				const AABB bounds{ node.minAABB, node.maxAABB };
+				const float nodeCost = node.IsLeaf() ? IntersectionCost * node.primitiveCount : TraversalCost;
+				return nodeCost * bounds.SurfaceArea();
+			});
+
+		const float rootArea = AABB{ nodes[0].minAABB, nodes[0].maxAABB }.SurfaceArea();
+		return rootArea > 0.f ? cost / rootArea : 0.f;
+	}
+
+	void BVH::CollapseToWide()
+	{
+		wideNodes.clear();
+
+		if (nodes.empty())
+			return;
+
+		//Never more wide nodes than binary inner nodes, +1 for a root that is a leaf
+		wideNodes.reserve(nodes.size() / 2 + 1);
+		wideNodes.emplace_back();
+
+		CollapseNode(0, 0);
+	}
+
+	void BVH::CollapseNode(uint32_t nodeIndex, uint32_t wideNodeIndex)
+	{
+		uint32_t children[WideBVHWidth]{};
+		uint32_t childCount{ 0 };
+
+		if (nodes[nodeIndex].IsLeaf())
+		{
+			children[childCount++] = nodeIndex;
+		}
+		else
+		{
+			children[childCount++] = nodes[nodeIndex].leftFirst;
+			children[childCount++] = nodes[nodeIndex].leftFirst + 1;
+		}
+
+		//Keep opening the largest inner child until every slot is used or only leaves are left
+		while (childCount < WideBVHWidth)
+		{
+			int largestChild{ -1 };
+			float largestArea{ -1.f };
+
+			for (uint32_t i{ 0 }; i < childCount; ++i)
+			{
+				const BVHNode& child = nodes[children[i]];
+				if (child.IsLeaf())
+					continue;
+
+				const float area = AABB{ child.minAABB, child.maxAABB }.SurfaceArea();
+				if (area > largestArea)
+				{
+					largestArea = area;
+					largestChild = static_cast<int>(i);
+				}
+			}
+
+			if (largestChild < 0)
+				break;
+
+			const uint32_t openedChild = children[largestChild];
+			children[largestChild] = nodes[openedChild].leftFirst;
+			children[childCount++] = nodes[openedChild].leftFirst + 1;
+		}
+
+		uint32_t innerChildren[WideBVHWidth]{};
+		uint32_t innerWideNodes[WideBVHWidth]{};
+		uint32_t innerCount{ 0 };
+
+		for (uint32_t slot{ 0 }; slot < WideBVHWidth; ++slot)
+		{
+			WideBVHNode& wideNode = wideNodes[wideNodeIndex];
+
+			if (slot >= childCount)
+			{
+				wideNode.minX[slot] = wideNode.minY[slot] = wideNode.minZ[slot] = INFINITY;
+				wideNode.maxX[slot] = wideNode.maxY[slot] = wideNode.maxZ[slot] = INFINITY;
+				wideNode.children[slot] = 0;
+				wideNode.primitiveCounts[slot] = 0;
+				continue;
+			}
+
+			const BVHNode& child = nodes[children[slot]];
+			wideNode.minX[slot] = child.minAABB.x;
+			wideNode.minY[slot] = child.minAABB.y;
+			wideNode.minZ[slot] = child.minAABB.z;
+			wideNode.maxX[slot] = child.maxAABB.x;
+			wideNode.maxY[slot] = child.maxAABB.y;
+			wideNode.maxZ[slot] = child.maxAABB.z;
+
+			if (child.IsLeaf())
+			{
+				wideNode.children[slot] = child.leftFirst;
+				wideNode.primitiveCounts[slot] = child.primitiveCount;
+			}
+			else
+			{
+				const uint32_t childWideIndex{ static_cast<uint32_t>(wideNodes.size()) };
+				wideNode.children[slot] = childWideIndex;
+				wideNode.primitiveCounts[slot] = 0;
+
+				//Invalidates wideNode, it is fetched again every slot
+				wideNodes.emplace_back();
+
+				innerChildren[innerCount] = children[slot];
+				innerWideNodes[innerCount] = childWideIndex;
+				++innerCount;
+			}
+		}
+
+		for (uint32_t i{ 0 }; i < innerCount; ++i)
+		{
+			CollapseNode(innerChildren[i], innerWideNodes[i]);
+		}
+	}
+
+	void BVH::Quantize()
+	{
+		quantizedNodes.clear();
+
+		if (nodes.empty())
+			return;
+
+		quantizedBounds = AABB{ nodes[0].minAABB, nodes[0].maxAABB };
+
+		//Inner nodes only, +1 for a root that is a leaf
+		quantizedNodes.reserve(nodes.size() / 2 + 1);
+		quantizedNodes.emplace_back();
+
+		QuantizeNode(0, 0, quantizedBounds);
+	}
+
+	void BVH::QuantizeNode(uint32_t nodeIndex, uint32_t quantizedNodeIndex, const AABB& decodedBounds)
+	{
+		//A leaf root takes the first slot of a node of its own, the second one stays empty
+		const BVHNode& node = nodes[nodeIndex];
+		const uint32_t children[2]{ node.IsLeaf() ? nodeIndex : node.leftFirst, node.leftFirst + 1 };
+		const uint32_t childCount{ node.IsLeaf() ? 1u : 2u };
+
+		const float parentMin[3]{ decodedBounds.min.x, decodedBounds.min.y, decodedBounds.min.z };
+		const float parentMax[3]{ decodedBounds.max.x, decodedBounds.max.y, decodedBounds.max.z };
+
+		AABB decodedChildren[2]{};
+		uint32_t innerChildren[2]{};
+		uint32_t innerCount{ 0 };
+
+		for (uint32_t slot{ 0 }; slot < childCount; ++slot)
+		{
+			const BVHNode& child = nodes[children[slot]];
+			QuantizedBVHNode& quantizedNode = quantizedNodes[quantizedNodeIndex];
+
+			float childMin[3]{};
+			float childMax[3]{};
+
+			for (int axis{ 0 }; axis < 3; ++axis)
+			{
+				const float extent{ parentMax[axis] - parentMin[axis] };
+				const float scale{ extent > 0.f ? QuantizedBVHNode::Steps / extent : 0.f };
+
+				const float minSteps{ std::floor((child.minAABB[axis] - parentMin[axis]) * scale) };
+				const float maxSteps{ std::ceil((child.maxAABB[axis] - parentMin[axis]) * scale) };
+				uint8_t& quantizedMin = quantizedNode.quantizedMin[slot][axis];
+				uint8_t& quantizedMax = quantizedNode.quantizedMax[slot][axis];
+				quantizedMin = static_cast<uint8_t>(std::clamp(minSteps, 0.f, QuantizedBVHNode::Steps));
+				quantizedMax = static_cast<uint8_t>(std::clamp(maxSteps, 0.f, QuantizedBVHNode::Steps));
+
+				//The estimate can be off by rounding, step outwards until the decoded planes no longer cut into the exact box
+				quantizedNode.DecodeChild(parentMin, parentMax, slot, childMin, childMax);
+				while (quantizedMin > 0 && childMin[axis] > child.minAABB[axis])
+				{
+					--quantizedMin;
+					quantizedNode.DecodeChild(parentMin, parentMax, slot, childMin, childMax);
+				}
+
+				while (quantizedMax < 255 && childMax[axis] < child.maxAABB[axis])
+				{
+					++quantizedMax;
+					quantizedNode.DecodeChild(parentMin, parentMax, slot, childMin, childMax);
+				}
+			}
+
+			quantizedNode.DecodeChild(parentMin, parentMax, slot, childMin, childMax);
+			decodedChildren[slot] = AABB{ Vector3{ childMin[0], childMin[1], childMin[2] }, Vector3{ childMax[0], childMax[1], childMax[2] } };
+
+			if (child.IsLeaf())
+			{
+				quantizedNode.children[slot] = child.leftFirst;
+				quantizedNode.primitiveCounts[slot] = child.primitiveCount;
+			}
+			else
+			{
+				const uint32_t childQuantizedIndex{ static_cast<uint32_t>(quantizedNodes.size()) };
+				quantizedNode.children[slot] = childQuantizedIndex;
+				quantizedNode.primitiveCounts[slot] = 0;
+
+				//Invalidates quantizedNode, it is fetched again every slot
+				quantizedNodes.emplace_back();
+
+				innerChildren[innerCount++] = slot;
+			}
+		}
+
+		//The children are quantized against what the traversal will decode for them, not against their exact bounds
+		for (uint32_t i{ 0 }; i < innerCount; ++i)
+		{
+			const uint32_t slot{ innerChildren[i] };
+			QuantizeNode(children[slot], quantizedNodes[quantizedNodeIndex].children[slot], decodedChildren[slot]);
+		}
+	}
+
+	void BVH::BuildLevels()
+	{
+		m_LevelNodes.reserve(nodes.size());
+		m_LevelNodes.emplace_back(0);
+		m_LevelOffsets.emplace_back(0);
+
+		//Breadth first, every pass appends the children of the previous level and closes that level's range
+		size_t levelBegin{ 0 };
+		while (levelBegin < m_LevelNodes.size())
+		{
+			const size_t levelEnd{ m_LevelNodes.size() };
+			m_LevelOffsets.emplace_back(static_cast<uint32_t>(levelEnd));
+
+			for (size_t i{ levelBegin }; i < levelEnd; ++i)
+			{
+				const BVHNode& node = nodes[m_LevelNodes[i]];
+				if (!node.IsLeaf())
+				{
+					m_LevelNodes.emplace_back(node.leftFirst);
+					m_LevelNodes.emplace_back(node.leftFirst + 1);
+				}
+			}
+
+			levelBegin = levelEnd;
+		}
+	}
+
+	void BVH::Subdivide(uint32_t nodeIndex, uint32_t depth, BuildContext& context)
+	{
+		const uint32_t first{ nodes[nodeIndex].leftFirst };
+		const uint32_t count{ nodes[nodeIndex].primitiveCount };
+
+		AABB nodeBounds{};
+		AABB centroidBounds{};
+		for (uint32_t i{ first }; i < first + count; ++i)
+		{
+			nodeBounds.Grow(context.primitiveBounds[primitiveIndices[i]]);
+			centroidBounds.Grow(context.centroids[primitiveIndices[i]]);
+		}
+
+		nodes[nodeIndex].minAABB = nodeBounds.min;
+		nodes[nodeIndex].maxAABB = nodeBounds.max;
+
+		//The traversal stack holds one entry per level
+		if (count <= 1 || depth + 1 >= MaxDepth)
+			return;
+
+		//Bin the centroids along every axis and evaluate the BinCount - 1 planes between the bins
+		float bestCost{ FLT_MAX };
+		int bestAxis{ -1 };
+		uint32_t bestBin{ 0 };
+
+		for (int axis{ 0 }; axis < 3; ++axis)
+		{
+			const float axisMin{ centroidBounds.min[axis] };
+			const float axisExtent{ centroidBounds.max[axis] - axisMin };
+			if (axisExtent <= 0.f)
+				continue;
+
+			const float binScale{ BinCount / axisExtent };
+
+			AABB binBounds[BinCount]{};
+			uint32_t binCounts[BinCount]{};
+
+			for (uint32_t i{ first }; i < first + count; ++i)
+			{
+				const uint32_t primitiveIndex{ primitiveIndices[i] };
+				const uint32_t bin{ std::min(BinCount - 1, static_cast<uint32_t>((context.centroids[primitiveIndex][axis] - axisMin) * binScale)) };
+
+				binBounds[bin].Grow(context.primitiveBounds[primitiveIndex]);
+				++binCounts[bin];
+			}
+
+			float leftAreas[BinCount - 1]{};
+			uint32_t leftCounts[BinCount - 1]{};
+
+			AABB leftBounds{};
+			uint32_t leftCount{ 0 };
+			for (uint32_t bin{ 0 }; bin < BinCount - 1; ++bin)
+			{
+				leftCount += binCounts[bin];
+				if (binCounts[bin] > 0)
+					leftBounds.Grow(binBounds[bin]);
+
+				leftCounts[bin] = leftCount;
+				leftAreas[bin] = leftCount > 0 ? leftBounds.SurfaceArea() : 0.f;
+			}
+
+			AABB rightBounds{};
+			uint32_t rightCount{ 0 };
+			for (uint32_t bin{ BinCount - 1 }; bin > 0; --bin)
+			{
+				rightCount += binCounts[bin];
+				if (binCounts[bin] > 0)
+					rightBounds.Grow(binBounds[bin]);
+
+				if (leftCounts[bin - 1] == 0 || rightCount == 0)
+					continue;
+
+				const float cost = leftAreas[bin - 1] * leftCounts[bin - 1] + rightBounds.SurfaceArea() * rightCount;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = bin;
+				}
+			}
+		}
+
+		const float parentArea{ nodeBounds.SurfaceArea() };
+		const float leafCost{ IntersectionCost * count };
+		const float splitCost{ bestAxis >= 0 && parentArea > 0.f ? TraversalCost + IntersectionCost * bestCost / parentArea : leafCost };
+
+		if (splitCost >= leafCost && count <= MaxLeafSize)
+			return;
+
+		//Every centroid in the same spot: no plane separates them, so just halve the range
+		const auto begin = primitiveIndices.begin() + first;
+		const auto end = begin + count;
+		auto middle = begin + count / 2;
+
+		if (bestAxis >= 0)
+		{
+			const float axisMin{ centroidBounds.min[bestAxis] };
+			const float binScale{ BinCount / (centroidBounds.max[bestAxis] - axisMin) };
+
+			middle = std::partition(begin, end, [&](uint32_t primitiveIndex)
+				{
+					return std::min(BinCount - 1, static_cast<uint32_t>((context.centroids[primitiveIndex][bestAxis] - axisMin) * binScale)) < bestBin;
+				});
+		}
+
+		const uint32_t leftCount{ static_cast<uint32_t>(middle - begin) };
+
+		const uint32_t leftIndex{ context.nodeCount.fetch_add(2) };
+		nodes[leftIndex].leftFirst = first;
+		nodes[leftIndex].primitiveCount = leftCount;
+		nodes[leftIndex + 1].leftFirst = first + leftCount;
+		nodes[leftIndex + 1].primitiveCount = count - leftCount;
+
+		nodes[nodeIndex].leftFirst = leftIndex;
+		nodes[nodeIndex].primitiveCount = 0;
+
+		if (depth < context.parallelDepth && count >= MinParallelBuildSize)
+		{
+			auto leftTask = std::async(std::launch::async, [&]() { Subdivide(leftIndex, depth + 1, context); });
+			Subdivide(leftIndex + 1, depth + 1, context);
+			leftTask.get();
+		}
+		else
+		{
+			Subdivide(leftIndex, depth + 1, context);
+			Subdivide(leftIndex + 1, depth + 1, context);
+		}
+	}
+
+	//Spreads the lowest 10 bits so two zero bits follow every one of them
+	static uint32_t ExpandMortonBits(uint32_t value)
+	{
+		value = (value * 0x00010001u) & 0xFF0000FFu;
+		value = (value * 0x00000101u) & 0x0F00F00Fu;
+		value = (value * 0x00000011u) & 0xC30C30C3u;
+		value = (value * 0x00000005u) & 0x49249249u;
+		return value;
+	}
+
+	uint32_t BVH::MortonCode(const Vector3& point, const AABB& bounds)
+	{
+		const float gridSize{ static_cast<float>((1u << MortonBitsPerAxis) - 1) };
+
+		uint32_t code{ 0 };
+		for (int axis{ 0 }; axis < 3; ++axis)
+		{
+			const float extent{ bounds.max[axis] - bounds.min[axis] };
+			const float cell{ extent > 0.f ? (point[axis] - bounds.min[axis]) / extent * gridSize : 0.f };
+
+			code |= ExpandMortonBits(static_cast<uint32_t>(std::clamp(cell, 0.f, gridSize))) << (2 - axis);
+		}
+
+		return code;
+	}
+
+	void BVH::SortMortonCodes(BuildContext& context)
+	{
+		const size_t primitiveCount{ context.centroids.size() };
+
+		AABB centroidBounds{};
+		for (const Vector3& centroid : context.centroids)
+		{
+			centroidBounds.Grow(centroid);
+		}
+
+		//Code in the upper half, primitive index in the lower half, so sorting the keys drags the indices along
+		std::vector<uint64_t> keys(primitiveCount);
+		std::transform(std::execution::par, context.centroids.begin(), context.centroids.end(), keys.begin(), [&](const Vector3& centroid)
+			{
+				const size_t primitiveIndex{ static_cast<size_t>(&centroid - context.centroids.data()) };
+				return (static_cast<uint64_t>(MortonCode(centroid, centroidBounds)) << 32) | primitiveIndex;
+			});
+
+		//LSD radix sort over the 30 code bits, 8 bits per pass. Every chunk builds its own histogram and scatters
+		//its keys in order, the prefix sum runs digit-major so equal digits keep the order of their chunks
+		constexpr uint32_t RadixBits{ 8 };
+		constexpr uint32_t BucketCount{ 1u << RadixBits };
+
+		const size_t threadCount{ std::max(1u, std::thread::hardware_concurrency()) };
+		const size_t chunkCount{ std::clamp<size_t>(primitiveCount / MinParallelBuildSize, 1, threadCount * 4) };
+		const size_t chunkSize{ (primitiveCount + chunkCount - 1) / chunkCount };
+
+		std::vector<uint32_t> chunks(chunkCount);
+		std::iota(chunks.begin(), chunks.end(), 0);
+
+		std::vector<uint64_t> sortedKeys(primitiveCount);
+		std::vector<size_t> offsets(chunkCount * BucketCount);
+
+		for (uint32_t shift{ 32 }; shift < 32 + 3 * MortonBitsPerAxis; shift += RadixBits)
+		{
+			std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](uint32_t chunk)
+				{
+					size_t* histogram{ &offsets[chunk * BucketCount] };
+					std::fill(histogram, histogram + BucketCount, 0);
+
+					const size_t end{ std::min(primitiveCount, (chunk + 1) * chunkSize) };
+					for (size_t i{ chunk * chunkSize }; i < end; ++i)
+					{
+						++histogram[(keys[i] >> shift) & (BucketCount - 1)];
+					}
+				});
+
+			size_t offset{ 0 };
+			for (uint32_t bucket{ 0 }; bucket < BucketCount; ++bucket)
+			{
+				for (size_t chunk{ 0 }; chunk < chunkCount; ++chunk)
+				{
+					const size_t count{ offsets[chunk * BucketCount + bucket] };
+					offsets[chunk * BucketCount + bucket] = offset;
+					offset += count;
+				}
+			}
+
+			std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](uint32_t chunk)
+				{
+					size_t* chunkOffsets{ &offsets[chunk * BucketCount] };
+
+					const size_t end{ std::min(primitiveCount, (chunk + 1) * chunkSize) };
+					for (size_t i{ chunk * chunkSize }; i < end; ++i)
+					{
+						sortedKeys[chunkOffsets[(keys[i] >> shift) & (BucketCount - 1)]++] = keys[i];
+					}
+				});
+
+			keys.swap(sortedKeys);
+		}
+
+		context.mortonCodes.resize(primitiveCount);
+		std::for_each(std::execution::par, keys.begin(), keys.end(), [&](const uint64_t& key)
+			{
+				const size_t i{ static_cast<size_t>(&key - keys.data()) };
+				context.mortonCodes[i] = static_cast<uint32_t>(key >> 32);
+				primitiveIndices[i] = static_cast<uint32_t>(key);
+			});
+	}
+
+	void BVH::SubdivideLinear(uint32_t nodeIndex, uint32_t depth, BuildContext& context)
+	{
+		const uint32_t first{ nodes[nodeIndex].leftFirst };
+		const uint32_t count{ nodes[nodeIndex].primitiveCount };
+
+		if (count <= MaxLinearLeafSize || depth + 1 >= MaxDepth)
+			return;
+
+		//Split where the highest bit that differs inside the range flips, the codes are sorted so that is one binary search.
+		//Identical codes have nothing to split on, those ranges are halved
+		const auto codesBegin = context.mortonCodes.begin() + first;
+		const auto codesEnd = codesBegin + count;
+		const uint32_t differingBits{ *codesBegin ^ *(codesEnd - 1) };
+
+		uint32_t leftCount{ count / 2 };
+		if (differingBits != 0)
+		{
+			const uint32_t splitBit{ 31u - static_cast<uint32_t>(std::countl_zero(differingBits)) };
+			const auto split = std::partition_point(codesBegin, codesEnd, [splitBit](uint32_t code) { return ((code >> splitBit) & 1u) == 0; });
+			leftCount = static_cast<uint32_t>(split - codesBegin);
+		}
+
+		const uint32_t leftIndex{ context.nodeCount.fetch_add(2) };
+		nodes[leftIndex].leftFirst = first;
+		nodes[leftIndex].primitiveCount = leftCount;
+		nodes[leftIndex + 1].leftFirst = first + leftCount;
+		nodes[leftIndex + 1].primitiveCount = count - leftCount;
+
+		nodes[nodeIndex].leftFirst = leftIndex;
+		nodes[nodeIndex].primitiveCount = 0;
+
+		if (depth < context.parallelDepth && count >= MinParallelBuildSize)
+		{
+			auto leftTask = std::async(std::launch::async, [&]() { SubdivideLinear(leftIndex, depth + 1, context); });
+			SubdivideLinear(leftIndex + 1, depth + 1, context);
+			leftTask.get();
+		}
+		else
+		{
+			SubdivideLinear(leftIndex, depth + 1, context);
+			SubdivideLinear(leftIndex + 1, depth + 1, context);
+		}
+	}
+}
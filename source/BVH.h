@@ -0,0 +1,172 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "Math.h"
+
+//Build-time switch: trace meshes through the collapsed wide BVH instead of the binary one
+#define WIDE_BVH
+//Build-time switch: trace meshes through the 8-bit quantized nodes, takes precedence over WIDE_BVH for closest hits
+//#define QUANTIZED_BVH
+
+namespace dae
+{
+	//AVX2 tests 8 child boxes per node at once, SSE 4
+#if defined(__AVX2__)
+	constexpr uint32_t WideBVHWidth{ 8 };
+#else
+	constexpr uint32_t WideBVHWidth{ 4 };
+#endif
+
+	//SAH gives the best trees, Linear sorts Morton codes and splits on their bits: a lot faster to build
+	//and a bit slower to trace, for trees that have to be rebuilt every frame
+	enum class BVHBuildQuality
+	{
+		SAH,
+		Linear
+	};
+
+	struct AABB
+	{
+		Vector3 min{ FLT_MAX, FLT_MAX, FLT_MAX };
+		Vector3 max{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		void Grow(const Vector3& point)
+		{
+			min = Vector3::Min(min, point);
+			max = Vector3::Max(max, point);
+		}
+
+		void Grow(const AABB& other)
+		{
+			min = Vector3::Min(min, other.min);
+			max = Vector3::Max(max, other.max);
+		}
+
+		Vector3 Centroid() const
+		{
+			return (min + max) * 0.5f;
+		}
+
+		float SurfaceArea() const
+		{
+			const Vector3 extent = max - min;
+			return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+		}
+	};
+
+	//32 byte node, siblings are stored next to each other so one index addresses both children
+	struct BVHNode
+	{
+		Vector3 minAABB{};
+		uint32_t leftFirst{}; //index of the left child (inner node) or of the first primitive (leaf)
+		Vector3 maxAABB{};
+		uint32_t primitiveCount{}; //0 for inner nodes
+
+		bool IsLeaf() const { return primitiveCount > 0; }
+	};
+
+	//Collapsed node storing the bounds of all its children as SoA, so one SIMD slab test covers every child.
+	//Unused slots get an empty box at +infinity that no ray can hit
+	struct alignas(32) WideBVHNode
+	{
+		float minX[WideBVHWidth];
+		float minY[WideBVHWidth];
+		float minZ[WideBVHWidth];
+		float maxX[WideBVHWidth];
+		float maxY[WideBVHWidth];
+		float maxZ[WideBVHWidth];
+
+		uint32_t children[WideBVHWidth]; //wide node index (inner child) or first primitive (leaf child)
+		uint32_t primitiveCounts[WideBVHWidth]; //0 for inner children
+	};
+
+	//Binary node that stores the bounds of both children as 8-bit offsets inside its own box, which the traversal
+	//already decoded from the parent. Leaves live in their parent's slot, so there are only as many nodes as inner nodes.
+	//Quantization rounds outwards, a decoded box always contains the exact one
+	struct alignas(32) QuantizedBVHNode
+	{
+		uint8_t quantizedMin[2][3]{};
+		uint8_t quantizedMax[2][3]{};
+		uint32_t children[2]{}; //quantized node index (inner child) or first primitive (leaf child)
+		uint32_t primitiveCounts[2]{}; //0 for inner children, an empty slot has child 0 and count 0
+
+		static constexpr float Steps{ 255.f };
+
+		bool IsEmpty(uint32_t child) const { return children[child] == 0 && primitiveCounts[child] == 0; }
+
+		//Shared by the build and the traversal so both decode bit for bit the same box. Plain floats, it runs for every visited child.
+		//min counts up from the parent min and max down from the parent max, so 0 and 255 reproduce the parent exactly
+		void DecodeChild(const float parentMin[3], const float parentMax[3], uint32_t child, float childMin[3], float childMax[3]) const
+		{
+			for (int axis{ 0 }; axis < 3; ++axis)
+			{
+				const float step = (parentMax[axis] - parentMin[axis]) * (1.f / Steps);
+				childMin[axis] = parentMin[axis] + quantizedMin[child][axis] * step;
+				childMax[axis] = parentMax[axis] - (Steps - quantizedMax[child][axis]) * step;
+			}
+		}
+	};
+
+	//Binary bounding volume hierarchy built with a binned surface area heuristic or as a Morton code LBVH.
+	//The top levels of the build are split into parallel tasks, the subtrees below run on the task that reached them.
+	//The BVH only knows about primitive bounds, primitiveIndices maps the leaf ranges back to the caller's primitives.
+	struct BVH
+	{
+		static constexpr uint32_t MaxDepth{ 64 };
+		static constexpr uint32_t MaxLeafSize{ 8 };
+		static constexpr float TraversalCost{ 1.f };
+		static constexpr float IntersectionCost{ 1.f };
+		static constexpr uint32_t BinCount{ 16 };
+		static constexpr uint32_t MinParallelBuildSize{ 4096 }; //smaller subtrees are not worth a task
+		static constexpr uint32_t MaxLinearLeafSize{ 4 }; //Morton splits ignore the primitive sizes, smaller leaves keep the boxes tight
+		static constexpr uint32_t MortonBitsPerAxis{ 10 };
+
+		std::vector<BVHNode> nodes{};
+		std::vector<uint32_t> primitiveIndices{};
+
+		//Same leaves as nodes, collapsed to WideBVHWidth children per node. Only kept up to date when WIDE_BVH is defined
+		std::vector<WideBVHNode> wideNodes{};
+
+		//Same tree with quantized child bounds, rooted in quantizedBounds. Only kept up to date when QUANTIZED_BVH is defined
+		std::vector<QuantizedBVHNode> quantizedNodes{};
+		AABB quantizedBounds{};
+
+		//SAH cost right after the last Build, refits compare against it to judge how far the tree has degraded
+		float buildCost{};
+		float buildMilliseconds{};
+
+		void Build(const std::vector<AABB>& primitiveBounds, BVHBuildQuality quality = BVHBuildQuality::SAH);
+		//Same topology, new bounds: recomputes every node bottom-up, one tree level at a time in parallel
+		void Refit(const std::vector<AABB>& primitiveBounds);
+		float CalculateCost() const;
+		//30-bit Morton code of point on a 1024^3 grid over bounds
+		static uint32_t MortonCode(const Vector3& point, const AABB& bounds);
+		void CollapseToWide();
+		void Quantize();
+		bool IsEmpty() const { return nodes.empty(); }
+
+	private:
+		//Node indices grouped per tree level, deepest level last
+		std::vector<uint32_t> m_LevelNodes{};
+		std::vector<uint32_t> m_LevelOffsets{};
+
+		void BuildLevels();
+		void RefitNodes(const std::vector<AABB>& primitiveBounds);
+		void CollapseNode(uint32_t nodeIndex, uint32_t wideNodeIndex);
+		void QuantizeNode(uint32_t nodeIndex, uint32_t quantizedNodeIndex, const AABB& decodedBounds);
+		struct BuildContext
+		{
+			const std::vector<AABB>& primitiveBounds;
+			std::vector<Vector3> centroids;
+			std::atomic<uint32_t> nodeCount;
+			uint32_t parallelDepth;
+			std::vector<uint32_t> mortonCodes; //Linear only, sorted and parallel to primitiveIndices
+		};
+
+		void Subdivide(uint32_t nodeIndex, uint32_t depth, BuildContext& context);
+		void SortMortonCodes(BuildContext& context);
+		void SubdivideLinear(uint32_t nodeIndex, uint32_t depth, BuildContext& context);
+	};
+}
@@ -0,0 +1,749 @@
+#include "Benchmark.h"
+
+#include "SDL.h"
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#include "FramePipeline.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "Utils.h"
+
+namespace dae {
+
+	namespace
+	{
+		//Prints the report and writes it to fileName
+		void WriteReport(const std::ostringstream& report, const char* fileName)
+		{
+			std::cout << report.str();
+			std::ofstream{ fileName } << report.str();
+		}
+
+		//Runs benchmark on a Renderer for a hidden 640x480 window with the W4 reference scene, Initialized and with its top level BVH built.
+		//The report is written with WriteReport afterwards, also when the window could not be created
+		void RunWithHiddenWindow(std::ostringstream& report, const char* fileName, const std::function<void(SDL_Window*, Renderer&, Scene_W4_ReferenceScene&)>& benchmark)
+		{
+			SDL_Init(SDL_INIT_VIDEO);
+			SDL_Window* pWindow = SDL_CreateWindow("RayTracer - Benchmark", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 640, 480, SDL_WINDOW_HIDDEN);
+
+			if (pWindow)
+			{
+				{
+					Renderer renderer{ pWindow };
+					Scene_W4_ReferenceScene scene{};
+					scene.Initialize();
+					scene.UpdateTopLevelBVH();
+
+					benchmark(pWindow, renderer, scene);
+				}
+
+				SDL_DestroyWindow(pWindow);
+			}
+
+			SDL_Quit();
+
+			WriteReport(report, fileName);
+		}
+	}
+
+	void Benchmark::BVHTraversal(const std::vector<std::string>& objFiles, uint32_t rayCount)
+	{
+		std::ofstream fileStream("benchmark_bvh.txt");
+
+		for (const std::string& objFile : objFiles)
+		{
+			TriangleMesh mesh{};
+			mesh.cullMode = TriangleCullMode::NoCulling;
+
+			if (!Utils::ParseOBJ(objFile, mesh.positions, mesh.normals, mesh.indices) || mesh.indices.empty())
+			{
+				std::cout << "Could not load " << objFile << std::endl;
+				continue;
+			}
+
+			mesh.UpdateAABB();
+			mesh.UpdateBVH();
+			mesh.UpdateTransforms();
+
+			if (mesh.bvh.wideNodes.empty())
+				mesh.bvh.CollapseToWide();
+
+			if (mesh.bvh.quantizedNodes.empty())
+				mesh.bvh.Quantize();
+
+			//Same triangles as a Morton code LBVH
+			TriangleMesh linearMesh{};
+			linearMesh.cullMode = mesh.cullMode;
+			linearMesh.buildQuality = BVHBuildQuality::Linear;
+			linearMesh.positions = mesh.positions;
+			linearMesh.normals = mesh.normals;
+			linearMesh.indices = mesh.indices;
+			linearMesh.UpdateAABB();
+			linearMesh.UpdateBVH();
+			linearMesh.UpdateTransforms();
+
+			if (linearMesh.bvh.wideNodes.empty())
+				linearMesh.bvh.CollapseToWide();
+
+			//Rays start on a sphere around the mesh and aim at a random point inside its bounds
+			const Vector3 center = (mesh.minAABB + mesh.maxAABB) * 0.5f;
+			const float radius = (mesh.maxAABB - mesh.minAABB).Magnitude();
+
+			std::mt19937 generator{ 2024 };
+			std::uniform_real_distribution<float> unit{ -1.f, 1.f };
+			std::uniform_real_distribution<float> zeroToOne{ 0.f, 1.f };
+
+			std::vector<Ray> rays(rayCount);
+			for (Ray& ray : rays)
+			{
+				Vector3 offset{ unit(generator), unit(generator), unit(generator) };
+				offset.Normalize();
+
+				const Vector3 target{
+					Lerpf(mesh.minAABB.x, mesh.maxAABB.x, zeroToOne(generator)),
+					Lerpf(mesh.minAABB.y, mesh.maxAABB.y, zeroToOne(generator)),
+					Lerpf(mesh.minAABB.z, mesh.maxAABB.z, zeroToOne(generator)) };
+
+				ray.origin = center + offset * radius;
+				ray.direction = (target - ray.origin).Normalized();
+			}
+
+			uint32_t hitTriangle{};
+			const auto traceAll = [&](auto traverse, uint32_t& hitCount)
+				{
+					hitCount = 0;
+					const auto start = std::chrono::high_resolution_clock::now();
+
+					for (const Ray& ray : rays)
+					{
+						HitRecord hitRecord{};
+						traverse(ray, hitRecord);
+
+						if (hitRecord.didHit)
+							++hitCount;
+					}
+
+					const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+					return rays.size() / elapsed.count() / 1e6;
+				};
+
+			uint32_t binaryHits{}, wideHits{}, quantizedHits{}, linearHits{};
+
+			const double binaryMRays = traceAll([&](const Ray& ray, HitRecord& hitRecord)
+				{
+					GeometryUtils::Traverse_BVH(mesh.bvh, ray, hitRecord, [&](uint32_t first, uint32_t count)
+						{
+							if (GeometryUtils::HitTest_TriangleMeshLeaf(mesh, ray, hitRecord, first, count, hitTriangle))
+								hitRecord.didHit = true;
+						});
+				}, binaryHits);
+
+			const double wideMRays = traceAll([&](const Ray& ray, HitRecord& hitRecord)
+				{
+					GeometryUtils::Traverse_WideBVH(mesh.bvh, ray, hitRecord, [&](uint32_t first, uint32_t count)
+						{
+							if (GeometryUtils::HitTest_TriangleMeshLeaf(mesh, ray, hitRecord, first, count, hitTriangle))
+								hitRecord.didHit = true;
+						});
+				}, wideHits);
+
+			const double quantizedMRays = traceAll([&](const Ray& ray, HitRecord& hitRecord)
+				{
+					GeometryUtils::Traverse_QuantizedBVH(mesh.bvh, ray, hitRecord, [&](uint32_t first, uint32_t count)
+						{
+							if (GeometryUtils::HitTest_TriangleMeshLeaf(mesh, ray, hitRecord, first, count, hitTriangle))
+								hitRecord.didHit = true;
+						});
+				}, quantizedHits);
+
+			const double linearMRays = traceAll([&](const Ray& ray, HitRecord& hitRecord)
+				{
+					GeometryUtils::Traverse_WideBVH(linearMesh.bvh, ray, hitRecord, [&](uint32_t first, uint32_t count)
+						{
+							if (GeometryUtils::HitTest_TriangleMeshLeaf(linearMesh, ray, hitRecord, first, count, hitTriangle))
+								hitRecord.didHit = true;
+						});
+				}, linearHits);
+
+			const size_t binaryBytes{ mesh.bvh.nodes.size() * sizeof(BVHNode) };
+			const size_t wideBytes{ mesh.bvh.wideNodes.size() * sizeof(WideBVHNode) };
+			const size_t quantizedBytes{ mesh.bvh.quantizedNodes.size() * sizeof(QuantizedBVHNode) };
+			const size_t triangleBytes{ mesh.positions.size() * sizeof(Vector3) + mesh.indices.size() * sizeof(int) };
+
+			std::ostringstream report{};
+			report << "**BVH TRAVERSAL** " << objFile << '\n';
+			report << ">> TRIANGLES = " << mesh.indices.size() / 3 << '\n';
+			report << ">> VERTEX + INDEX DATA = " << triangleBytes / 1024 << " KB\n";
+			report << ">> SAH BUILD = " << mesh.bvh.buildMilliseconds << " ms (cost " << mesh.bvh.buildCost << ")\n";
+			report << ">> LINEAR BUILD = " << linearMesh.bvh.buildMilliseconds << " ms (cost " << linearMesh.bvh.buildCost << ")\n";
+			report << ">> BINARY NODES = " << mesh.bvh.nodes.size() << " (" << binaryBytes / 1024 << " KB)\n";
+			report << ">> BVH" << WideBVHWidth << " NODES = " << mesh.bvh.wideNodes.size() << " (" << wideBytes / 1024 << " KB)\n";
+			report << ">> QUANTIZED NODES = " << mesh.bvh.quantizedNodes.size() << " (" << quantizedBytes / 1024 << " KB, " << static_cast<float>(quantizedBytes) / binaryBytes << "x binary)\n";
+			report << ">> BINARY = " << binaryMRays << " MRays/s (" << binaryHits << " hits)\n";
+			report << ">> BVH" << WideBVHWidth << " = " << wideMRays << " MRays/s (" << wideHits << " hits)\n";
+			report << ">> QUANTIZED = " << quantizedMRays << " MRays/s (" << quantizedHits << " hits)\n";
+			report << ">> SPEEDUP BVH" << WideBVHWidth << " = " << wideMRays / binaryMRays << "x\n";
+			report << ">> SPEEDUP QUANTIZED = " << quantizedMRays / binaryMRays << "x\n";
+			report << ">> LINEAR BVH" << WideBVHWidth << " = " << linearMRays << " MRays/s (" << linearHits << " hits, " << linearMRays / wideMRays << "x SAH)\n";
+
+			std::cout << report.str();
+			fileStream << report.str();
+		}
+	}
+
+	void Benchmark::SphereIntersection(uint32_t sphereCount, uint32_t rayCount)
+	{
+		std::mt19937 generator{ 2024 };
+		std::uniform_real_distribution<float> unit{ -1.f, 1.f };
+		std::uniform_real_distribution<float> radius{ .05f, .2f };
+
+		//Spheres fill a 20 unit cube, rays start on its surface and cross it
+		std::vector<Sphere> spheres(sphereCount);
+		for (Sphere& sphere : spheres)
+		{
+			sphere.origin = Vector3{ unit(generator), unit(generator), unit(generator) } * 10.f;
+			sphere.radius = radius(generator);
+		}
+
+		SpherePool pool{};
+		pool.Resize(sphereCount);
+		for (uint32_t i = 0; i < sphereCount; ++i)
+		{
+			pool.Set(i, spheres[i]);
+		}
+
+		std::vector<Ray> rays(rayCount);
+		for (Ray& ray : rays)
+		{
+			ray.origin = Vector3{ unit(generator), unit(generator), -1.f } * 10.f;
+			ray.direction = (Vector3{ unit(generator), unit(generator), 1.f } * 10.f - ray.origin).Normalized();
+		}
+
+		const auto traceAll = [&](auto intersect, uint32_t& hitCount)
+			{
+				hitCount = 0;
+				const auto start = std::chrono::high_resolution_clock::now();
+
+				for (const Ray& ray : rays)
+				{
+					HitRecord hitRecord{};
+					intersect(ray, hitRecord);
+
+					if (hitRecord.didHit)
+						++hitCount;
+				}
+
+				const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+				return static_cast<double>(rays.size()) * sphereCount / elapsed.count() / 1e6;
+			};
+
+		uint32_t scalarHits{}, groupHits{};
+
+		const double scalarMTests = traceAll([&](const Ray& ray, HitRecord& hitRecord)
+			{
+				for (const Sphere& sphere : spheres)
+				{
+					GeometryUtils::HitTest_Sphere(sphere, ray, hitRecord);
+				}
+			}, scalarHits);
+
+		const double groupMTests = traceAll([&](const Ray& ray, HitRecord& hitRecord)
+			{
+				for (uint32_t group = 0; group < pool.GroupCount(); ++group)
+				{
+					GeometryUtils::HitTest_SphereGroup(pool, group, ray, hitRecord);
+				}
+			}, groupHits);
+
+		std::ostringstream report{};
+		report << "**SPHERE INTERSECTION** " << sphereCount << " spheres, " << rayCount << " rays\n";
+		report << ">> SCALAR = " << scalarMTests << " M sphere tests/s (" << scalarHits << " hits)\n";
+		report << ">> GROUPS OF " << SpherePool::GroupSize << " = " << groupMTests << " M sphere tests/s (" << groupHits << " hits)\n";
+		report << ">> SPEEDUP = " << groupMTests / scalarMTests << "x\n";
+
+		WriteReport(report, "benchmark_spheres.txt");
+	}
+
+	void Benchmark::MathLayer(uint32_t frameCount)
+	{
+		std::ostringstream report{};
+
+		const auto timeMilliseconds = [](auto&& function, uint32_t repetitions)
+			{
+				const auto start = std::chrono::high_resolution_clock::now();
+				for (uint32_t i = 0; i < repetitions; ++i)
+				{
+					function();
+				}
+
+				const std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+				return elapsed.count() / repetitions;
+			};
+
+		//The per vertex work UpdateTransforms did before meshes were traced in object space
+		{
+			constexpr uint32_t VertexCount{ 1000000 };
+
+			std::mt19937 generator{ 2024 };
+			std::uniform_real_distribution<float> unit{ -1.f, 1.f };
+
+			std::vector<Vector3> points(VertexCount);
+			for (Vector3& point : points)
+			{
+				point = { unit(generator), unit(generator), unit(generator) };
+			}
+
+			std::vector<Vector3> transformed(VertexCount);
+			const Matrix transform = Matrix::CreateScale(2.f, 2.f, 2.f) * Matrix::CreateRotationY(.5f) * Matrix::CreateTranslation(1.f, 2.f, 3.f);
+
+			const double pointByPoint = timeMilliseconds([&]()
+				{
+					for (uint32_t i = 0; i < VertexCount; ++i)
+					{
+						transformed[i] = transform.TransformPoint(points[i]);
+					}
+				}, 10);
+
+			const double batched = timeMilliseconds([&]()
+				{
+					transform.TransformPoints(points.data(), transformed.data(), VertexCount);
+				}, 10);
+
+			report << "**TRANSFORM POINTS** " << VertexCount << " vertices\n";
+			report << ">> POINT BY POINT = " << pointByPoint << " ms\n";
+			report << ">> BATCHED = " << batched << " ms\n";
+		}
+
+		{
+			TriangleMesh rigidMesh{};
+			TriangleMesh deformingMesh{};
+			deformingMesh.isDeforming = true;
+
+			for (TriangleMesh* pMesh : { &rigidMesh, &deformingMesh })
+			{
+				Utils::ParseOBJ("Resources/lowpoly_bunny.obj", pMesh->positions, pMesh->normals, pMesh->indices);
+				pMesh->UpdateAABB();
+				pMesh->UpdateBVH();
+				pMesh->UpdateTransforms();
+			}
+
+			float yaw{};
+			const double rigid = timeMilliseconds([&]()
+				{
+					rigidMesh.RotateY(yaw += .01f);
+					rigidMesh.UpdateTransforms();
+				}, 10000);
+
+			const double deforming = timeMilliseconds([&]()
+				{
+					deformingMesh.RotateY(yaw += .01f);
+					deformingMesh.UpdateTransforms();
+				}, 1000);
+
+			report << "**UPDATE TRANSFORMS** lowpoly_bunny.obj\n";
+			report << ">> RIGID = " << rigid * 1000.0 << " us\n";
+			report << ">> DEFORMING (REFIT) = " << deforming * 1000.0 << " us\n";
+		}
+
+		//Full frames, RenderPixel for every pixel of a 640x480 window that is never shown
+		RunWithHiddenWindow(report, "benchmark_math.txt", [&](SDL_Window*, Renderer& renderer, Scene_W4_ReferenceScene& scene)
+			{
+				renderer.Render(&scene);
+				const double frame = timeMilliseconds([&]() { renderer.Render(&scene); }, frameCount);
+
+				report << "**RENDER** W4 reference scene, 640x480\n";
+				report << ">> FRAME = " << frame << " ms\n";
+			});
+	}
+
+	void Benchmark::RenderPaths(uint32_t frameCount)
+	{
+		std::ostringstream report{};
+
+		RunWithHiddenWindow(report, "benchmark_render.txt", [&](SDL_Window*, Renderer& renderer, Scene_W4_ReferenceScene& scene)
+			{
+				report << "**RENDER PATHS** W4 reference scene, 640x480, " << frameCount << " frames\n";
+
+				for (int path{ 0 }; path < 2; ++path)
+				{
+					//The first frame sizes the buffers, it is not timed
+					renderer.Render(&scene);
+
+					Renderer::WavefrontTimings stageTotals{};
+					const auto start = std::chrono::high_resolution_clock::now();
+					for (uint32_t frame = 0; frame < frameCount; ++frame)
+					{
+						renderer.Render(&scene);
+
+						const Renderer::WavefrontTimings& timings = renderer.GetWavefrontTimings();
+						stageTotals.generate += timings.generate;
+						stageTotals.intersect += timings.intersect;
+						stageTotals.sort += timings.sort;
+						stageTotals.shade += timings.shade;
+						stageTotals.shadow += timings.shadow;
+						stageTotals.write += timings.write;
+					}
+					const std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+					if (!renderer.IsWavefrontEnabled())
+					{
+						report << ">> PER PIXEL = " << elapsed.count() / frameCount << " ms\n";
+					}
+					else
+					{
+						report << ">> WAVEFRONT = " << elapsed.count() / frameCount << " ms\n";
+						report << "   GENERATE = " << stageTotals.generate / frameCount << " ms\n";
+						report << "   INTERSECT = " << stageTotals.intersect / frameCount << " ms\n";
+						report << "   COMPACT + SORT = " << stageTotals.sort / frameCount << " ms\n";
+						report << "   SHADE = " << stageTotals.shade / frameCount << " ms\n";
+						report << "   SHADOW = " << stageTotals.shadow / frameCount << " ms\n";
+						report << "   WRITE = " << stageTotals.write / frameCount << " ms\n";
+					}
+
+					renderer.ToggleWavefront();
+				}
+			});
+	}
+
+	void Benchmark::TileScheduler(uint32_t frameCount)
+	{
+		std::ostringstream report{};
+
+		RunWithHiddenWindow(report, "benchmark_tiles.txt", [&](SDL_Window*, Renderer& renderer, Scene_W4_ReferenceScene& scene)
+			{
+				report << "**TILE SCHEDULER** W4 reference scene, 640x480, " << frameCount << " frames per tile size\n";
+
+				for (const uint32_t tileSize : { 8u, 16u, 32u, 64u })
+				{
+					renderer.SetTileSize(tileSize);
+
+					//The first frame after a resize is not timed
+					renderer.Render(&scene);
+
+					Renderer::TileStatistics totals{};
+					float maxImbalance{};
+					const auto start = std::chrono::high_resolution_clock::now();
+					for (uint32_t frame = 0; frame < frameCount; ++frame)
+					{
+						renderer.Render(&scene);
+
+						const Renderer::TileStatistics& statistics = renderer.GetTileStatistics();
+						totals.wall += statistics.wall;
+						totals.overhead += statistics.overhead;
+						totals.imbalance += statistics.imbalance;
+						totals.steals += statistics.steals;
+						totals.tiles = statistics.tiles;
+						totals.threads = statistics.threads;
+						maxImbalance = std::max(maxImbalance, statistics.imbalance);
+					}
+					const std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+					report << ">> " << tileSize << "x" << tileSize << " = " << elapsed.count() / frameCount << " ms per frame, "
+						<< totals.tiles << " tiles on " << totals.threads << " threads\n";
+					report << "   TILES = " << totals.wall / frameCount << " ms\n";
+					report << "   SCHEDULING OVERHEAD = " << totals.overhead / frameCount << " ms\n";
+					report << "   LOAD IMBALANCE = " << totals.imbalance / frameCount << " average, " << maxImbalance << " worst\n";
+					report << "   STEALS = " << float(totals.steals) / frameCount << " per frame\n";
+				}
+			});
+	}
+
+	void Benchmark::PipelineModes(uint32_t frameCount)
+	{
+		std::ostringstream report{};
+
+		RunWithHiddenWindow(report, "benchmark_pipeline.txt", [&](SDL_Window*, Renderer& renderer, Scene_W4_ReferenceScene& scene)
+			{
+				Scene_W4_ReferenceScene snapshot{};
+				snapshot.Initialize();
+
+				Timer timer{};
+				timer.Start();
+
+				report << "**FRAME PIPELINE** W4 reference scene, 640x480, " << frameCount << " frames per mode\n";
+
+				for (const FramePipeline::Mode mode : { FramePipeline::Mode::Latency, FramePipeline::Mode::Throughput })
+				{
+					FramePipeline pipeline{ &renderer, &scene, &snapshot, mode };
+
+					//The first frames size the buffers and fill the pipeline, they are not timed
+					for (int frame = 0; frame < 2; ++frame)
+					{
+						pipeline.Frame(&timer);
+						timer.Update();
+					}
+					pipeline.Flush();
+
+					FramePipeline::Timings totals{};
+					const auto start = std::chrono::high_resolution_clock::now();
+					for (uint32_t frame = 0; frame < frameCount; ++frame)
+					{
+						pipeline.Frame(&timer);
+						timer.Update();
+
+						const FramePipeline::Timings timings = pipeline.GetTimings();
+						totals.update += timings.update;
+						totals.trace += timings.trace;
+						totals.resolve += timings.resolve;
+						totals.present += timings.present;
+						totals.latency += timings.latency;
+					}
+					pipeline.Flush();
+					const std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+					report << ">> " << (mode == FramePipeline::Mode::Latency ? "LATENCY" : "THROUGHPUT") << " = " << elapsed.count() / frameCount << " ms per frame\n";
+					report << "   UPDATE = " << totals.update / frameCount << " ms\n";
+					report << "   TRACE = " << totals.trace / frameCount << " ms\n";
+					report << "   RESOLVE = " << totals.resolve / frameCount << " ms\n";
+					report << "   PRESENT = " << totals.present / frameCount << " ms\n";
+					report << "   UPDATE TO PRESENT = " << totals.latency / frameCount << " ms\n";
+				}
+			});
+	}
+
+	void Benchmark::ProgressiveRefinement(float frameBudget)
+	{
+		std::ostringstream report{};
+
+		RunWithHiddenWindow(report, "benchmark_progressive.txt", [&](SDL_Window*, Renderer& renderer, Scene_W4_ReferenceScene& scene)
+			{
+				report << "**PROGRESSIVE** W4 reference scene held still, 640x480, " << frameBudget << " ms budget\n";
+
+				//The first frame sizes the buffers, it is not timed
+				renderer.Render(&scene);
+
+				auto start = std::chrono::high_resolution_clock::now();
+				renderer.Render(&scene);
+				std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+				report << ">> FULL FRAME = " << elapsed.count() << " ms\n";
+
+				renderer.ToggleProgressive();
+				renderer.SetFrameBudget(frameBudget);
+
+				double totalTime{};
+				for (uint32_t frame = 1; frame <= Renderer::ProgressivePasses; ++frame)
+				{
+					start = std::chrono::high_resolution_clock::now();
+					renderer.Render(&scene);
+					elapsed = std::chrono::high_resolution_clock::now() - start;
+					totalTime += elapsed.count();
+
+					const Renderer::ProgressiveStatistics& statistics = renderer.GetProgressiveStatistics();
+					report << ">> FRAME " << frame << " = " << elapsed.count() << " ms, " << statistics.passes << " passes, "
+						<< statistics.refined << "/" << Renderer::ProgressivePasses << " refined\n";
+
+					if (statistics.refined == Renderer::ProgressivePasses)
+						break;
+				}
+				report << "   COMPLETE AFTER = " << totalTime << " ms\n";
+			});
+	}
+
+	void Benchmark::DynamicResolution(uint32_t frameCount)
+	{
+		std::ostringstream report{};
+
+		RunWithHiddenWindow(report, "benchmark_dynamic_resolution.txt", [&](SDL_Window*, Renderer& renderer, Scene_W4_ReferenceScene& scene)
+			{
+				Timer timer{};
+				timer.Start();
+
+				const auto renderFrame = [&]()
+					{
+						scene.Update(&timer);
+						scene.UpdateTopLevelBVH();
+						renderer.Render(&scene);
+						timer.Update();
+						renderer.ReportFrameTime(timer.GetElapsed());
+					};
+
+				//The first frame sizes the buffers, it is not timed
+				renderFrame();
+
+				constexpr uint32_t nativeFrames{ 5 };
+				float nativeTime{};
+				for (uint32_t frame = 0; frame < nativeFrames; ++frame)
+				{
+					renderFrame();
+					nativeTime += timer.GetElapsed() * 1000.f / nativeFrames;
+				}
+
+				const float targetFPS{ 2000.f / nativeTime };
+				renderer.SetTargetFPS(targetFPS);
+				renderer.ToggleDynamicResolution();
+
+				report << "**DYNAMIC RESOLUTION** W4 reference scene, 640x480 window, " << frameCount << " frames\n";
+				report << ">> NATIVE = " << nativeTime << " ms, TARGET = " << targetFPS << " FPS (" << 1000.f / targetFPS << " ms)\n";
+
+				//The second half shows where the controller settled
+				float settledTime{}, settledWorst{};
+				for (uint32_t frame = 1; frame <= frameCount; ++frame)
+				{
+					renderFrame();
+					const float frameTime{ timer.GetElapsed() * 1000.f };
+					report << ">> FRAME " << frame << " = " << frameTime << " ms at " << renderer.GetRenderWidth() << "x" << renderer.GetRenderHeight() << "\n";
+
+					if (frame > frameCount / 2)
+					{
+						settledTime += frameTime / (frameCount - frameCount / 2);
+						settledWorst = std::max(settledWorst, frameTime);
+					}
+				}
+				report << "   SETTLED = " << settledTime << " ms average, " << settledWorst << " ms worst\n";
+			});
+	}
+
+	void Benchmark::ThreadScaling(const ThreadPool::Configuration& configuration, uint32_t frameCount)
+	{
+		std::ostringstream report{};
+
+		const std::vector<std::vector<uint32_t>> cores{ ThreadPool::GetProcessorCores() };
+		uint32_t logicalProcessors{};
+		for (const std::vector<uint32_t>& core : cores)
+		{
+			logicalProcessors += static_cast<uint32_t>(core.size());
+		}
+
+		uint32_t maxThreads{ configuration.threadCount };
+		if (maxThreads == 0)
+			maxThreads = configuration.useSMT ? logicalProcessors : static_cast<uint32_t>(cores.size());
+
+		RunWithHiddenWindow(report, "benchmark_scaling.txt", [&](SDL_Window*, Renderer& renderer, Scene_W4_ReferenceScene& scene)
+			{
+				constexpr const char* affinityNames[]{ "NONE", "COMPACT", "SCATTER" };
+				report << "**THREAD SCALING** W4 reference scene, 640x480, " << frameCount << " frames per thread count\n";
+				report << ">> " << cores.size() << " physical cores, " << logicalProcessors << " logical processors, AFFINITY = "
+					<< affinityNames[static_cast<int>(configuration.affinity)] << ", SMT = " << (configuration.useSMT ? "ON" : "OFF") << "\n";
+
+				double singleThreadTime{};
+				for (uint32_t threadCount{ 1 }; threadCount <= maxThreads; ++threadCount)
+				{
+					ThreadPool::Configuration pool{ configuration };
+					pool.threadCount = threadCount;
+					renderer.ConfigureThreads(pool);
+
+					//The first frame on a new pool is not timed
+					renderer.Render(&scene);
+
+					float imbalance{};
+					const auto start = std::chrono::high_resolution_clock::now();
+					for (uint32_t frame = 0; frame < frameCount; ++frame)
+					{
+						renderer.Render(&scene);
+						imbalance += renderer.GetTileStatistics().imbalance / frameCount;
+					}
+					const std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+					const double frameTime{ elapsed.count() / frameCount };
+					if (threadCount == 1)
+						singleThreadTime = frameTime;
+
+					//Without PARRALEL_EXECUTION every pool has one worker, whatever was asked for
+					const uint32_t workers{ renderer.GetThreadCount() };
+					const double speedup{ singleThreadTime / frameTime };
+					report << ">> " << threadCount << " THREADS = " << frameTime << " ms per frame, SPEEDUP = " << speedup
+						<< "x, EFFICIENCY = " << speedup / workers * 100.0 << "%, LOAD IMBALANCE = " << imbalance;
+
+					const std::vector<uint32_t>& processors = renderer.GetThreadProcessors();
+					if (!processors.empty())
+					{
+						report << ", ON";
+						for (const uint32_t processor : processors)
+						{
+							report << " " << processor;
+						}
+					}
+					report << "\n";
+				}
+			});
+	}
+
+	void Benchmark::BRDFTables()
+	{
+		using Tables = BRDF::CookTorrenceTables;
+		const Tables& tables = Tables::Get();
+		const Vector3 normal{ 0.f, 0.f, 1.f };
+
+		std::ostringstream report{};
+		report << "**COOK-TORRENCE TABLES** " << Tables::CosineSize << " cosines x " << Tables::RoughnessSize << " roughnesses\n";
+
+		//Accuracy: D relative to its peak, so the tails of smooth lobes do not dominate, and G absolute since it is in [0, 1]
+		constexpr uint32_t sweepCount{ 4096 };
+		for (const float roughness : { 0.01f, 0.05f, 0.1f, 0.2f, 0.5f, 0.6f, 1.f })
+		{
+			const float alpha2{ roughness * roughness };
+			const float k{ (roughness + 1.0f) * (roughness + 1.0f) / 8.0f };
+			const Tables::Row row = Tables::GetRow(roughness);
+			const float peak = BRDF::NormalDistribution_GGX_Alpha2(normal, normal, alpha2);
+
+			float maxDistributionError{}, sumDistributionError{}, maxGeometryError{};
+			for (uint32_t i{ 1 }; i <= sweepCount; ++i)
+			{
+				const float cosine{ static_cast<float>(i) / sweepCount };
+				const Vector3 half{ sqrtf(1.f - cosine * cosine), 0.f, cosine };
+
+				const float distributionError = std::abs(tables.NormalDistribution(cosine, row) - BRDF::NormalDistribution_GGX_Alpha2(normal, half, alpha2)) / peak;
+				maxDistributionError = std::max(maxDistributionError, distributionError);
+				sumDistributionError += distributionError;
+
+				maxGeometryError = std::max(maxGeometryError, std::abs(tables.GeometrySchlickGGX(cosine, row) - BRDF::GeometryFunction_SchlickGGX_K(normal, half, k)));
+			}
+
+			report << ">> ROUGHNESS " << roughness << ": D MAX ERROR = " << maxDistributionError * 100.f << "% of peak, MEAN = " << sumDistributionError / sweepCount * 100.f
+				<< "%, G MAX ERROR = " << maxGeometryError << "\n";
+		}
+
+		//Throughput: D and both halves of G for random cosines and roughnesses, the sum keeps the work alive
+		constexpr uint32_t sampleCount{ 1 << 22 };
+		std::mt19937 generator{ 2024 };
+		std::uniform_real_distribution<float> unit{ 0.f, 1.f };
+
+		std::vector<float> cosines(sampleCount), roughnesses(sampleCount);
+		for (uint32_t i = 0; i < sampleCount; ++i)
+		{
+			cosines[i] = unit(generator);
+			roughnesses[i] = unit(generator);
+		}
+
+		const auto evaluateAll = [&](auto evaluate, float& sum)
+			{
+				sum = 0.f;
+				const auto start = std::chrono::high_resolution_clock::now();
+
+				for (uint32_t i = 0; i < sampleCount; ++i)
+				{
+					sum += evaluate(cosines[i], roughnesses[i]);
+				}
+
+				const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+				return sampleCount / elapsed.count() / 1e6;
+			};
+
+		float analyticSum{}, tableSum{};
+		const double analyticMEvaluations = evaluateAll([&](float cosine, float roughness)
+			{
+				const Vector3 half{ sqrtf(1.f - cosine * cosine), 0.f, cosine };
+				const float k{ (roughness + 1.0f) * (roughness + 1.0f) / 8.0f };
+				return BRDF::NormalDistribution_GGX_Alpha2(normal, half, roughness * roughness) * BRDF::GeometryFunction_Smith_K(normal, half, half, k);
+			}, analyticSum);
+
+		const double tableMEvaluations = evaluateAll([&](float cosine, float roughness)
+			{
+				const Tables::Row row = Tables::GetRow(roughness);
+				const float geometry = tables.GeometrySchlickGGX(cosine, row);
+				return tables.NormalDistribution(cosine, row) * geometry * geometry;
+			}, tableSum);
+
+		report << ">> ANALYTIC = " << analyticMEvaluations << " M D*G evaluations/s (sum " << analyticSum << ")\n";
+		report << ">> TABLES = " << tableMEvaluations << " M D*G evaluations/s (sum " << tableSum << ")\n";
+		report << ">> SPEEDUP = " << tableMEvaluations / analyticMEvaluations << "x\n";
+
+		WriteReport(report, "benchmark_brdf_tables.txt");
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+namespace dae
+{
+	namespace Benchmark
+	{
+		/**
+		 * \brief Traces the same random rays through the binary and the wide BVH of every mesh and prints the throughput of both
+		 * \param objFiles meshes to load, the results are also written to benchmark_bvh.txt
+		 * \param rayCount number of rays traced per mesh and per traversal
+		 */
+		void BVHTraversal(const std::vector<std::string>& objFiles, uint32_t rayCount = 1000000);
+
+		/**
+		 * \brief Intersects random rays with every sphere of a random cloud, once one sphere at a time and once a SpherePool group at a time
+		 * \param sphereCount spheres in the cloud, the results are also written to benchmark_spheres.txt
+		 * \param rayCount number of rays per kernel, every ray is tested against every sphere
+		 */
+		void SphereIntersection(uint32_t sphereCount = 4096, uint32_t rayCount = 10000);
+
+		/**
+		 * \brief Times the paths that lean on the math layer: transforming a vertex array point by point and batched,
+		 * UpdateTransforms on a rigid and a deforming mesh, and full frames of the W4 reference scene in a hidden window
+		 * \param frameCount frames rendered, the results are also written to benchmark_math.txt
+		 */
+		void MathLayer(uint32_t frameCount = 20);
+
+		/**
+		 * \brief A/B of the per pixel and the wavefront render path on the W4 reference scene in a hidden window,
+		 * with the time the wavefront path spends in each of its stages
+		 * \param frameCount frames rendered per path, the results are also written to benchmark_render.txt
+		 */
+		void RenderPaths(uint32_t frameCount = 20);
+
+		/**
+		 * \brief Accuracy of BRDF::CookTorrenceTables against the analytic D and G over a sweep of cosines and roughnesses
+		 * and the throughput of both scalar, the results are also written to benchmark_brdf_tables.txt
+		 */
+		void BRDFTables();
+
+		/**
+		 * \brief Per pixel frames of the W4 reference scene in a hidden window for a sweep of tile sizes,
+		 * with the scheduling overhead, load imbalance and steals of the worker pool
+		 * \param frameCount frames rendered per tile size, the results are also written to benchmark_tiles.txt
+		 */
+		void TileScheduler(uint32_t frameCount = 20);
+
+		/**
+		 * \brief Frames of the animated W4 reference scene through FramePipeline in a hidden window, in latency and in throughput mode,
+		 * with the average time per stage and the latency from update to present
+		 * \param frameCount frames rendered per mode, the results are also written to benchmark_pipeline.txt
+		 */
+		void PipelineModes(uint32_t frameCount = 50);
+
+		/**
+		 * \brief Progressive frames of the W4 reference scene held still in a hidden window, frame by frame until the image is complete,
+		 * next to the time of one full frame
+		 * \param frameBudget milliseconds of tracing per progressive frame, the results are also written to benchmark_progressive.txt
+		 */
+		void ProgressiveRefinement(float frameBudget = 16.f);
+
+		/**
+		 * \brief Frames of the animated W4 reference scene in a hidden window with dynamic resolution aiming at twice the FPS
+		 * the window size renders at, frame by frame with the render size the controller picked
+		 * \param frameCount frames rendered with the controller on, the results are also written to benchmark_dynamic_resolution.txt
+		 */
+		void DynamicResolution(uint32_t frameCount = 40);
+
+		/**
+		 * \brief Per pixel frames of the W4 reference scene held still in a hidden window on a render pool of 1 up to N threads,
+		 * with the speedup over one thread and the parallel efficiency of every thread count
+		 * \param configuration N, the affinity policy and SMT use of the pools, N = 0 sweeps up to every usable logical processor
+		 * \param frameCount frames rendered per thread count, the results are also written to benchmark_scaling.txt
+		 */
+		void ThreadScaling(const ThreadPool::Configuration& configuration = {}, uint32_t frameCount = 10);
+	}
+}
@@ -22,6 +22,7 @@ namespace dae
 		}
 
 		#pragma region ColorRGB (Member) Operators
+		//Binary operators never touch *this, only the compound assignments do
 		const ColorRGB& operator+=(const ColorRGB& c)
 		{
 			r += c.r;
@@ -31,11 +32,6 @@ namespace dae
 			return *this;
 		}
 
-		const ColorRGB& operator+(const ColorRGB& c)
-		{
-			return *this += c;
-		}
-
 		ColorRGB operator+(const ColorRGB& c) const
 		{
 			return { r + c.r, g + c.g, b + c.b };
@@ -50,11 +46,6 @@ namespace dae
 			return *this;
 		}
 
-		const ColorRGB& operator-(const ColorRGB& c)
-		{
-			return *this -= c;
-		}
-
 		ColorRGB operator-(const ColorRGB& c) const
 		{
 			return { r - c.r, g - c.g, b - c.b };
@@ -69,11 +60,6 @@ namespace dae
 			return *this;
 		}
 
-		const ColorRGB& operator*(const ColorRGB& c)
-		{
-			return *this *= c;
-		}
-
 		ColorRGB operator*(const ColorRGB& c) const
 		{
 			return { r * c.r, g * c.g, b * c.b };
@@ -88,9 +74,9 @@ namespace dae
 			return *this;
 		}
 
-		const ColorRGB& operator/(const ColorRGB& c)
+		ColorRGB operator/(const ColorRGB& c) const
 		{
-			return *this /= c;
+			return { r / c.r, g / c.g, b / c.b };
 		}
 
 		const ColorRGB& operator*=(float s)
@@ -102,11 +88,6 @@ namespace dae
 			return *this;
 		}
 
-		const ColorRGB& operator*(float s)
-		{
-			return *this *= s;
-		}
-
 		ColorRGB operator*(float s) const
 		{
 			return { r * s, g * s,b * s };
@@ -121,9 +102,9 @@ namespace dae
 			return *this;
 		}
 
-		const ColorRGB& operator/(float s)
+		ColorRGB operator/(float s) const
 		{
-			return *this /= s;
+			return { r / s, g / s, b / s };
 		}
 		#pragma endregion
 	};
@@ -1,7 +1,10 @@
 #pragma once
 #include <cassert>
+#include <execution>
+#include <future>
 
 #include "Math.h"
+#include "BVH.h"
 #include "vector"
 
 namespace dae
@@ -15,6 +18,42 @@ namespace dae
 		unsigned char materialIndex{ 0 };
 	};
 
+	//Spheres as SoA in groups of GroupSize, one SIMD kernel tests a whole group.
+	//Lanes past count are zero padding so a group can always be loaded in full
+	struct SpherePool
+	{
+		static constexpr uint32_t GroupSize{ 8 };
+
+		std::vector<float> x{}, y{}, z{};
+		std::vector<float> radiusSquared{};
+		std::vector<unsigned char> materialIndices{};
+		uint32_t count{};
+
+		uint32_t GroupCount() const { return (count + GroupSize - 1) / GroupSize; }
+		uint32_t GroupLanes(uint32_t group) const { return std::min(GroupSize, count - group * GroupSize); }
+
+		void Resize(uint32_t sphereCount)
+		{
+			count = sphereCount;
+
+			const size_t paddedCount{ static_cast<size_t>(GroupCount()) * GroupSize };
+			for (auto* pComponent : { &x, &y, &z, &radiusSquared })
+			{
+				pComponent->assign(paddedCount, 0.f);
+			}
+			materialIndices.assign(paddedCount, 0);
+		}
+
+		void Set(uint32_t index, const Sphere& sphere)
+		{
+			x[index] = sphere.origin.x;
+			y[index] = sphere.origin.y;
+			z[index] = sphere.origin.z;
+			radiusSquared[index] = sphere.radius * sphere.radius;
+			materialIndices[index] = sphere.materialIndex;
+		}
+	};
+
 	struct Plane
 	{
 		Vector3 origin{};
@@ -54,6 +93,88 @@ namespace dae
 		unsigned char materialIndex{};
 	};
 
+	//Intersection data per triangle, precomputed once so the hit test needs no edges, cross product or sqrt.
+	//SoA, one entry per BVH primitive slot so a leaf reads a contiguous range
+	struct TriangleRecords
+	{
+		std::vector<float> v0x{}, v0y{}, v0z{};
+		std::vector<float> edge1x{}, edge1y{}, edge1z{};
+		std::vector<float> edge2x{}, edge2y{}, edge2z{};
+		std::vector<uint32_t> packedNormals{}; //face normal, octahedral 2x16 bit
+
+		size_t Size() const { return v0x.size(); }
+
+		void Resize(size_t count)
+		{
+			for (auto* pComponent : { &v0x, &v0y, &v0z, &edge1x, &edge1y, &edge1z, &edge2x, &edge2y, &edge2z })
+			{
+				pComponent->resize(count);
+			}
+			packedNormals.resize(count);
+		}
+
+		void Set(size_t index, const Vector3& v0, const Vector3& v1, const Vector3& v2)
+		{
+			const Vector3 edge1 = v1 - v0;
+			const Vector3 edge2 = v2 - v0;
+
+			v0x[index] = v0.x;
+			v0y[index] = v0.y;
+			v0z[index] = v0.z;
+			edge1x[index] = edge1.x;
+			edge1y[index] = edge1.y;
+			edge1z[index] = edge1.z;
+			edge2x[index] = edge2.x;
+			edge2y[index] = edge2.y;
+			edge2z[index] = edge2.z;
+			packedNormals[index] = PackNormal(Vector3::Cross(edge1, edge2));
+		}
+
+		//Octahedral encoding: project on the octahedron |x| + |y| + |z| = 1 and fold the lower half over the upper one
+		static uint32_t PackNormal(const Vector3& normal)
+		{
+			const float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+			if (length <= 0.f)
+				return 0;
+
+			float x = normal.x / length;
+			float y = normal.y / length;
+
+			if (normal.z < 0.f)
+			{
+				const float foldedX = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+				const float foldedY = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+				x = foldedX;
+				y = foldedY;
+			}
+
+			const auto toSnorm16 = [](float value)
+				{
+					return static_cast<uint32_t>(static_cast<uint16_t>(static_cast<int16_t>(std::round(std::clamp(value, -1.f, 1.f) * 32767.f))));
+				};
+
+			return toSnorm16(x) | (toSnorm16(y) << 16);
+		}
+
+		static Vector3 UnpackNormal(uint32_t packedNormal)
+		{
+			float x = static_cast<int16_t>(packedNormal & 0xFFFF) / 32767.f;
+			float y = static_cast<int16_t>(packedNormal >> 16) / 32767.f;
+			const float z = 1.f - std::abs(x) - std::abs(y);
+
+			if (z < 0.f)
+			{
+				const float unfoldedX = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+				const float unfoldedY = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+				x = unfoldedX;
+				y = unfoldedY;
+			}
+
+			return Vector3{ x, y, z }.Normalized();
+		}
+	};
+
+	//Mesh instance: the vertices and the BVH stay in object space, rays are moved into object space by inverseTransform
 	struct TriangleMesh
 	{
 		TriangleMesh() = default;
@@ -63,13 +184,17 @@ namespace dae
 			//Calculate Normals
 			CalculateNormals();
 
-			//Update Transforms
+			//Update Bounds + BVH + Transforms
+			UpdateAABB();
+			UpdateBVH();
 			UpdateTransforms();
 		}
 
 		TriangleMesh(const std::vector<Vector3>& _positions, const std::vector<int>& _indices, const std::vector<Vector3>& _normals, TriangleCullMode _cullMode) :
 			positions(_positions), indices(_indices), normals(_normals), cullMode(_cullMode)
 		{
+			UpdateAABB();
+			UpdateBVH();
 			UpdateTransforms();
 		}
 
@@ -84,14 +209,27 @@ namespace dae
 		Matrix translationTransform{};
 		Matrix scaleTransform{};
 
+		Matrix worldTransform{};
+		Matrix inverseTransform{};
+
 		Vector3 minAABB;
 		Vector3 maxAABB;
 
 		Vector3 transformedMinAABB;
 		Vector3 transformedMaxAABB;
 
-		std::vector<Vector3> transformedPositions{};
-		std::vector<Vector3> transformedNormals{};
+		//Object space, only rebuilt when the vertices change
+		BVH bvh{};
+		BVHBuildQuality buildQuality{ BVHBuildQuality::SAH }; //Linear for meshes whose topology changes every frame
+		TriangleRecords triangleRecords{};
+
+		//Deforming meshes move their vertices every frame: UpdateTransforms refits the BVH and
+		//hands a full rebuild to a background task once the refitted tree has degraded too far
+		bool isDeforming{ false };
+		float rebuildThreshold{ 1.5f }; //allowed SAH cost ratio refit / last build
+
+		std::vector<AABB> triangleBounds{};
+		std::future<BVH> pendingBVH{};
 
 		void Translate(const Vector3& translation)
 		{
@@ -108,6 +246,8 @@ namespace dae
 			scaleTransform = Matrix::CreateScale(scale);
 		}
 
+		//Only the bounds and the transforms follow the new triangle, the BVH is not rebuilt per triangle.
+		//Call UpdateBVH once every triangle is in, until then the mesh is traced with the BVH it had
 		void AppendTriangle(const Triangle& triangle, bool ignoreTransformUpdate = false)
 		{
 			int startIndex = static_cast<int>(positions.size());
@@ -123,8 +263,11 @@ namespace dae
 			normals.push_back(triangle.normal);
 
 			
-			if(!ignoreTransformUpdate)
+			if (!ignoreTransformUpdate)
+			{
+				UpdateAABB();
 				UpdateTransforms();
+			}
 		}
 
 		void CalculateNormals()
@@ -158,6 +301,7 @@ namespace dae
 			}
 		}
 
+		//Object space bounds, call after changing the vertices. UpdateBVH rebuilds the BVH over them
 		void UpdateAABB()
 		{
 			if (positions.size() > 0)
@@ -173,83 +317,116 @@ namespace dae
 			}
 		}
 
-
-		void UpdateTransforms()
+		void UpdateBVH()
 		{
-			
-			Matrix finalTransform = scaleTransform * rotationTransform * translationTransform;
+			UpdateTriangleBounds();
+			bvh.Build(triangleBounds, buildQuality);
 
-			
-			transformedPositions.clear();
-			transformedPositions.reserve(positions.size());
-			transformedNormals.clear();
-			transformedNormals.reserve(normals.size());
+			UpdateTriangleRecords();
 
-			
-			for (auto& p : positions)
+			//Rigid meshes never refit, no need to keep the bounds around
+			if (!isDeforming)
 			{
-				transformedPositions.emplace_back(finalTransform.TransformPoint(p));
+				triangleBounds.clear();
+				triangleBounds.shrink_to_fit();
 			}
+		}
 
-			/*for (auto& p : normals)
-			{
-				transformedNormals.emplace_back(finalTransform.TransformPoint(p));
-			}*/
+		void UpdateTriangleBounds()
+		{
+			triangleBounds.resize(indices.size() / 3);
 
-			//for (size_t i = 0; i < positions.size(); ++i)
-			//{
-			//	const Vector3& position = positions[i];
+			std::for_each(std::execution::par, triangleBounds.begin(), triangleBounds.end(), [this](AABB& bounds)
+				{
+					const size_t i = &bounds - triangleBounds.data();
 
-			//	// Transform the position using the final transformation matrix.
-			//	Vector3 transformedPosition = finalTransform.TransformPoint(position);
-			//	transformedPositions.push_back(transformedPosition);
+					bounds = AABB{};
+					bounds.Grow(positions[indices[i * 3]]);
+					bounds.Grow(positions[indices[i * 3 + 1]]);
+					bounds.Grow(positions[indices[i * 3 + 2]]);
+				});
+		}
 
-			//}
-			for (size_t i = 0; i < normals.size(); ++i)
-			{
-				const Vector3& normal = normals[i];
+		//Follows the BVH primitive order, so it has to be refreshed whenever the BVH or the vertices change
+		void UpdateTriangleRecords()
+		{
+			triangleRecords.Resize(bvh.primitiveIndices.size());
 
-				// To transform a normal vector, apply only the rotation part of the matrix.
-				Vector3 transformedNormal = rotationTransform.TransformVector(normal).Normalized();
-				transformedNormals.push_back(transformedNormal);
-			}
+			std::for_each(std::execution::par, bvh.primitiveIndices.begin(), bvh.primitiveIndices.end(), [this](const uint32_t& triangleIndex)
+				{
+					const size_t slot = &triangleIndex - bvh.primitiveIndices.data();
 
-			UpdateTransformedAABB(finalTransform);
-			
+					triangleRecords.Set(slot,
+						positions[indices[triangleIndex * 3]],
+						positions[indices[triangleIndex * 3 + 1]],
+						positions[indices[triangleIndex * 3 + 2]]);
+				});
 		}
 
-		void UpdateTransformedAABB(const Matrix& FinalTransform)
+		void RefitBVH()
 		{
-			Vector3 tMinAABB = FinalTransform.TransformPoint(minAABB);
-			Vector3 tMaxAABB = tMinAABB;
+			//Swap in a finished background rebuild, it was built from older vertices so it still gets refitted below
+			if (pendingBVH.valid() && pendingBVH.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+			{
+				bvh = pendingBVH.get();
+			}
 
-			Vector3 tAABB = FinalTransform.TransformPoint(maxAABB.x, minAABB.y, minAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+			UpdateTriangleBounds();
+			bvh.Refit(triangleBounds);
+			UpdateTriangleRecords();
 
-			tAABB = FinalTransform.TransformPoint(maxAABB.x, minAABB.y, maxAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+			if (!bvh.IsEmpty())
+			{
+				minAABB = bvh.nodes[0].minAABB;
+				maxAABB = bvh.nodes[0].maxAABB;
+			}
 
-			tAABB = FinalTransform.TransformPoint(minAABB.x, minAABB.y, maxAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+			if (!pendingBVH.valid() && bvh.CalculateCost() > bvh.buildCost * rebuildThreshold)
+			{
+				pendingBVH = std::async(std::launch::async, [bounds = triangleBounds, quality = buildQuality]()
+					{
+						BVH rebuilt{};
+						rebuilt.Build(bounds, quality);
+						return rebuilt;
+					});
+			}
+		}
 
-			tAABB = FinalTransform.TransformPoint(minAABB.x, maxAABB.y, minAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+		//Only touches the instance matrices and the world bounds, the vertices are never rewritten.
+		//Deforming meshes additionally refit their BVH to the current vertices, which is linear in the triangle count
+		void UpdateTransforms()
+		{
+			if (isDeforming)
+				RefitBVH();
 
-			tAABB = FinalTransform.TransformPoint(maxAABB.x, maxAABB.y, minAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+			worldTransform = scaleTransform * rotationTransform * translationTransform;
+			inverseTransform = Matrix::Inverse(worldTransform);
 
-			tAABB = FinalTransform.TransformPoint(maxAABB);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+			UpdateTransformedAABB(worldTransform);
+		}
 
-			tAABB = FinalTransform.TransformPoint(minAABB.x, maxAABB.y, minAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+		void UpdateTransformedAABB(const Matrix& FinalTransform)
+		{
+			Vector3 corners[8]{
+				{ minAABB.x, minAABB.y, minAABB.z },
+				{ maxAABB.x, minAABB.y, minAABB.z },
+				{ maxAABB.x, minAABB.y, maxAABB.z },
+				{ minAABB.x, minAABB.y, maxAABB.z },
+				{ minAABB.x, maxAABB.y, minAABB.z },
+				{ maxAABB.x, maxAABB.y, minAABB.z },
+				{ maxAABB.x, maxAABB.y, maxAABB.z },
+				{ minAABB.x, maxAABB.y, maxAABB.z } };
+
+			FinalTransform.TransformPoints(corners, corners, 8);
+
+			Vector3 tMinAABB = corners[0];
+			Vector3 tMaxAABB = corners[0];
+
+			for (const Vector3& corner : corners)
+			{
+				tMinAABB = Vector3::Min(corner, tMinAABB);
+				tMaxAABB = Vector3::Max(corner, tMaxAABB);
+			}
 
 			transformedMinAABB = tMinAABB;
 			transformedMaxAABB = tMaxAABB;
@@ -274,6 +451,47 @@ namespace dae
 
 		LightType type{};
 	};
+
+	//Lights as SoA in groups of GroupSize so one SIMD kernel shades a hit for a whole group.
+	//Point lights keep their origin, directional lights the normalized direction towards the light with positional 0,
+	//so to light = xyz - positional * hit works for both. Lanes past count are zero padding
+	struct LightPool
+	{
+		static constexpr uint32_t GroupSize{ 8 };
+
+		std::vector<float> x{}, y{}, z{};
+		std::vector<float> positional{};
+		std::vector<float> red{}, green{}, blue{}; //color * 4 * intensity / PI, point lights still divide by the squared distance
+		uint32_t count{};
+
+		uint32_t GroupCount() const { return (count + GroupSize - 1) / GroupSize; }
+		uint32_t GroupLanes(uint32_t group) const { return std::min(GroupSize, count - group * GroupSize); }
+
+		void Resize(uint32_t lightCount)
+		{
+			count = lightCount;
+
+			const size_t paddedCount{ static_cast<size_t>(GroupCount()) * GroupSize };
+			for (auto* pComponent : { &x, &y, &z, &positional, &red, &green, &blue })
+			{
+				pComponent->assign(paddedCount, 0.f);
+			}
+		}
+
+		void Set(uint32_t index, const Light& light)
+		{
+			const Vector3 toLight = light.type == LightType::Point ? light.origin : -light.direction.Normalized();
+			x[index] = toLight.x;
+			y[index] = toLight.y;
+			z[index] = toLight.z;
+			positional[index] = light.type == LightType::Point ? 1.f : 0.f;
+
+			const float radiantIntensity = 4 * light.intensity / PI;
+			red[index] = light.color.r * radiantIntensity;
+			green[index] = light.color.g * radiantIntensity;
+			blue[index] = light.color.b * radiantIntensity;
+		}
+	};
 #pragma endregion
 #pragma region MISC
 	struct Ray
@@ -285,6 +503,114 @@ namespace dae
 		float max{ FLT_MAX };
 	};
 
+	//Terms of the sphere and plane tests that only depend on the ray origin, shared by every ray that starts at point: the camera rays
+	//of a frame, and the shadow rays of a point light once they are traced backwards from the light. Filled once per frame,
+	//the kernels then only do the direction dependent part
+	struct PointInvariants
+	{
+		Vector3 point{};
+		std::vector<float> toPointX{}, toPointY{}, toPointZ{}; //point - sphere center, parallel to the SpherePool lanes
+		std::vector<float> sphereC{}; //Dot(toPoint, toPoint) - radius^2, the c of the quadratic for a ray starting at the point
+		std::vector<float> planeDistances{}; //Dot(plane.origin - point, plane.normal) per plane
+
+		void Update(const Vector3& _point, const SpherePool& spheres, const std::vector<Plane>& planes)
+		{
+			point = _point;
+
+			const size_t laneCount{ spheres.x.size() };
+			for (auto* pComponent : { &toPointX, &toPointY, &toPointZ, &sphereC })
+			{
+				pComponent->resize(laneCount);
+			}
+
+			for (size_t i = 0; i < laneCount; ++i)
+			{
+				toPointX[i] = point.x - spheres.x[i];
+				toPointY[i] = point.y - spheres.y[i];
+				toPointZ[i] = point.z - spheres.z[i];
+				sphereC[i] = (toPointX[i] * toPointX[i] + toPointY[i] * toPointY[i] + toPointZ[i] * toPointZ[i]) - spheres.radiusSquared[i];
+			}
+
+			planeDistances.resize(planes.size());
+			for (size_t i = 0; i < planes.size(); ++i)
+			{
+				planeDistances[i] = Vector3::Dot(planes[i].origin - point, planes[i].normal);
+			}
+		}
+	};
+
+	//Primary rays of a Width x Height pixel block, SoA so the packet kernels test 8 lanes per AVX register.
+	//All rays start at the camera: with a shared origin the packet kernels only differ per lane in the direction
+	struct RayPacket
+	{
+		static constexpr uint32_t Width{ 4 };
+		static constexpr uint32_t Height{ 4 };
+		static constexpr uint32_t Size{ Width * Height };
+		static_assert(Size <= 32, "lanes are addressed by a 32-bit mask");
+
+		Vector3 origin{};
+		float min{ 0.0001f };
+		float max{ FLT_MAX };
+
+		alignas(32) float directionX[Size]{};
+		alignas(32) float directionY[Size]{};
+		alignas(32) float directionZ[Size]{};
+		alignas(32) float inverseX[Size]{};
+		alignas(32) float inverseY[Size]{};
+		alignas(32) float inverseZ[Size]{};
+		alignas(32) float t[Size]{}; //closest hit so far per lane, kept in sync with the hit records by the packet hit tests
+
+		uint32_t mask{}; //lanes that hold a ray, blocks on the image border are partial
+
+		//Per axis range of the inverse directions over the lanes in mask, only meaningful when isCoherent
+		Vector3 inverseMin{};
+		Vector3 inverseMax{};
+		bool isCoherent{};
+
+		void SetRay(uint32_t lane, const Vector3& direction)
+		{
+			directionX[lane] = direction.x;
+			directionY[lane] = direction.y;
+			directionZ[lane] = direction.z;
+			mask |= 1u << lane;
+		}
+
+		Ray GetRay(uint32_t lane) const
+		{
+			return { origin, { directionX[lane], directionY[lane], directionZ[lane] }, min, max };
+		}
+
+		//Call once all rays are set. A packet is coherent when every direction has the same sign per axis,
+		//only then do the inverse direction ranges bound the slab distances of all its rays
+		void Prepare()
+		{
+			inverseMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+			inverseMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+			for (uint32_t lane{ 0 }; lane < Size; ++lane)
+			{
+				if (!(mask & (1u << lane)))
+					continue;
+
+				inverseX[lane] = 1.f / directionX[lane];
+				inverseY[lane] = 1.f / directionY[lane];
+				inverseZ[lane] = 1.f / directionZ[lane];
+				t[lane] = max;
+
+				inverseMin = Vector3::Min(inverseMin, { inverseX[lane], inverseY[lane], inverseZ[lane] });
+				inverseMax = Vector3::Max(inverseMax, { inverseX[lane], inverseY[lane], inverseZ[lane] });
+			}
+
+			isCoherent = mask != 0;
+			for (int axis{ 0 }; axis < 3; ++axis)
+			{
+				//A zero direction component has an infinite inverse, those packets are traced ray by ray as well
+				const bool sameSign = inverseMin[axis] > 0.f || inverseMax[axis] < 0.f;
+				isCoherent = isCoherent && sameSign && std::isfinite(inverseMin[axis]) && std::isfinite(inverseMax[axis]);
+			}
+		}
+	};
+
 	struct HitRecord
 	{
 		Vector3 origin{};
@@ -0,0 +1,214 @@
+#include "FramePipeline.h"
+
+#include <iostream>
+
+#include "Renderer.h"
+#include "Scene.h"
+#include "Timer.h"
+
+namespace dae {
+
+	namespace
+	{
+		float ElapsedMilliseconds(std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point end)
+		{
+			return std::chrono::duration<float, std::milli>(end - start).count();
+		}
+	}
+
+	FramePipeline::FramePipeline(Renderer* pRenderer, Scene* pScene, Scene* pSnapshot, Mode mode) :
+		m_pRenderer{ pRenderer },
+		m_pScenes{ pScene, pSnapshot },
+		m_Camera{ pScene->GetCamera() },
+		m_Mode{ mode }
+	{
+		for (std::vector<uint32_t>& buffer : m_Buffers)
+		{
+			buffer.assign(pRenderer->GetPixelCount(), 0u);
+		}
+
+		m_LastPresent = Clock::now();
+	}
+
+	FramePipeline::~FramePipeline()
+	{
+		Flush();
+	}
+
+	void FramePipeline::Frame(Timer* pTimer)
+	{
+		const Clock::time_point updateStart = Clock::now();
+
+		if (m_Mode == Mode::Latency)
+		{
+			Update(m_pScenes[m_Current], pTimer);
+			StartTrace(m_pScenes[m_Current], updateStart);
+			Flush();
+			return;
+		}
+
+		//The scene being traced is not touched, the next frame is built on the other one
+		const uint32_t next{ 1 - m_Current };
+		Update(m_pScenes[next], pTimer);
+
+		m_Tracer.Wait();
+		m_Current = next;
+		StartTrace(m_pScenes[m_Current], updateStart);
+
+		//The previous frame was handed to the presenter when its trace finished, it goes on screen while this one traces
+		m_Presenter.Wait();
+		UpdateWindow();
+	}
+
+	void FramePipeline::Flush()
+	{
+		m_Tracer.Wait();
+		m_Presenter.Wait();
+		UpdateWindow();
+	}
+
+	void FramePipeline::ToggleMode()
+	{
+		Flush();
+
+		m_Mode = m_Mode == Mode::Latency ? Mode::Throughput : Mode::Latency;
+		std::cout << " \nFRAME PIPELINE: " << (m_Mode == Mode::Latency ? "LATENCY" : "THROUGHPUT") << std::endl;
+	}
+
+	FramePipeline::Timings FramePipeline::GetTimings() const
+	{
+		std::lock_guard lock{ m_TimingsMutex };
+		return m_Timings;
+	}
+
+	void FramePipeline::Update(Scene* pScene, Timer* pTimer)
+	{
+		const Clock::time_point start = Clock::now();
+
+		pScene->GetCamera() = m_Camera;
+		pScene->Update(pTimer);
+		pScene->UpdateTopLevelBVH();
+
+		//Rendering recomputes forward from the yaw and pitch and the next camera update moves along it,
+		//do that here as well since the tracer works on its own copy
+		m_Camera = pScene->GetCamera();
+		m_Camera.CalculateCameraToWorld();
+
+		const float update{ ElapsedMilliseconds(start, Clock::now()) };
+		std::lock_guard lock{ m_TimingsMutex };
+		m_Timings.update = update;
+	}
+
+	void FramePipeline::StartTrace(Scene* pScene, Clock::time_point updateStart)
+	{
+		m_Tracer.Start([this, pScene, updateStart]()
+			{
+				const Clock::time_point traceStart = Clock::now();
+				m_pRenderer->Trace(pScene);
+				const Clock::time_point resolveStart = Clock::now();
+
+				//The presenter may still be busy with the other buffer, never with this one
+				std::vector<uint32_t>& buffer = m_Buffers[m_BackBuffer];
+				m_pRenderer->Resolve(buffer.data());
+				const Clock::time_point resolveEnd = Clock::now();
+
+				{
+					std::lock_guard lock{ m_TimingsMutex };
+					m_Timings.trace = ElapsedMilliseconds(traceStart, resolveStart);
+					m_Timings.resolve = ElapsedMilliseconds(resolveStart, resolveEnd);
+				}
+
+				//Start waits for the previous present, after that the other buffer is free for the next resolve
+				m_BackBuffer = 1 - m_BackBuffer;
+				m_Presenter.Start([this, &buffer, updateStart]()
+					{
+						std::lock_guard surfaceLock{ m_SurfaceMutex };
+
+						const Clock::time_point presentStart = Clock::now();
+						m_pRenderer->Present(buffer.data());
+						const Clock::time_point presentEnd = Clock::now();
+
+						m_SurfaceChanged = true;
+						m_SurfaceUpdateStart = updateStart;
+
+						std::lock_guard lock{ m_TimingsMutex };
+						m_Timings.present = ElapsedMilliseconds(presentStart, presentEnd);
+					});
+			});
+	}
+
+	void FramePipeline::UpdateWindow()
+	{
+		std::lock_guard surfaceLock{ m_SurfaceMutex };
+		if (!m_SurfaceChanged)
+			return;
+
+		const Clock::time_point updateStart = Clock::now();
+		m_pRenderer->UpdateWindow();
+		const Clock::time_point updateEnd = Clock::now();
+		m_SurfaceChanged = false;
+
+		std::lock_guard lock{ m_TimingsMutex };
+		m_Timings.present += ElapsedMilliseconds(updateStart, updateEnd);
+		m_Timings.frame = ElapsedMilliseconds(m_LastPresent, updateEnd);
+		m_Timings.latency = ElapsedMilliseconds(m_SurfaceUpdateStart, updateEnd);
+		m_LastPresent = updateEnd;
+	}
+
+#pragma region StageThread
+	FramePipeline::StageThread::StageThread() :
+		m_Thread{ &StageThread::Loop, this }
+	{
+	}
+
+	FramePipeline::StageThread::~StageThread()
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_Stopping = true;
+		}
+		m_Changed.notify_all();
+		m_Thread.join();
+	}
+
+	void FramePipeline::StageThread::Start(std::function<void()> job)
+	{
+		std::unique_lock lock{ m_Mutex };
+		m_Changed.wait(lock, [this]() { return !m_Busy; });
+
+		m_Job = std::move(job);
+		m_Busy = true;
+		lock.unlock();
+		m_Changed.notify_all();
+	}
+
+	void FramePipeline::StageThread::Wait()
+	{
+		std::unique_lock lock{ m_Mutex };
+		m_Changed.wait(lock, [this]() { return !m_Busy; });
+	}
+
+	void FramePipeline::StageThread::Loop()
+	{
+		while (true)
+		{
+			std::function<void()> job{};
+			{
+				std::unique_lock lock{ m_Mutex };
+				m_Changed.wait(lock, [this]() { return m_Stopping || m_Busy; });
+				if (m_Stopping)
+					return;
+				job = std::move(m_Job);
+			}
+
+			job();
+
+			{
+				std::lock_guard lock{ m_Mutex };
+				m_Busy = false;
+			}
+			m_Changed.notify_all();
+		}
+	}
+#pragma endregion
+}
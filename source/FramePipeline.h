@@ -0,0 +1,119 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Camera.h"
+
+namespace dae
+{
+	class Renderer;
+	class Scene;
+	class Timer;
+
+	//Runs the frame loop in three stages: update on the calling thread, trace + resolve and present on a thread each.
+	//Throughput mode overlaps them, the update of frame N + 1 runs on the second scene while frame N traces on the first one
+	//and frame N - 1 is copied into the window surface from the other half of a double buffer. That adds a frame of latency.
+	//Latency mode runs the stages back to back on one scene like Renderer::Render does.
+	//SDL only updates a window from the thread that created it, so the window update of a presented frame happens
+	//on the calling thread in the next Frame or Flush. Frame and Flush have to be called from that thread.
+	//Both scenes have to be the same scene type, Initialized, and their Update may only depend on the timer and the camera,
+	//the camera is carried over from one to the other every frame
+	class FramePipeline final
+	{
+	public:
+		enum class Mode
+		{
+			Latency,
+			Throughput
+		};
+
+		//Milliseconds per stage of the latest frame that went through it
+		struct Timings
+		{
+			float update{}; //Scene::Update and UpdateTopLevelBVH
+			float trace{};
+			float resolve{};
+			float present{}; //copy into the window surface and the window update
+			float frame{}; //between the last two presents
+			float latency{}; //from the start of the update of a frame to the end of its window update
+		};
+
+		FramePipeline(Renderer* pRenderer, Scene* pScene, Scene* pSnapshot, Mode mode = Mode::Throughput);
+		~FramePipeline();
+
+		FramePipeline(const FramePipeline&) = delete;
+		FramePipeline(FramePipeline&&) noexcept = delete;
+		FramePipeline& operator=(const FramePipeline&) = delete;
+		FramePipeline& operator=(FramePipeline&&) noexcept = delete;
+
+		//Updates the next frame and hands it to the tracer, in throughput mode this returns while it traces
+		void Frame(Timer* pTimer);
+		//Waits until every frame handed over so far is on screen, call it before changing renderer settings
+		void Flush();
+
+		void ToggleMode();
+		Mode GetMode() const { return m_Mode; }
+		Timings GetTimings() const;
+
+	private:
+		using Clock = std::chrono::high_resolution_clock;
+
+		//A thread that runs one job at a time, Start waits for the previous job before handing over the next one
+		class StageThread final
+		{
+		public:
+			StageThread();
+			~StageThread();
+
+			StageThread(const StageThread&) = delete;
+			StageThread(StageThread&&) noexcept = delete;
+			StageThread& operator=(const StageThread&) = delete;
+			StageThread& operator=(StageThread&&) noexcept = delete;
+
+			void Start(std::function<void()> job);
+			void Wait();
+
+		private:
+			std::mutex m_Mutex{};
+			std::condition_variable m_Changed{};
+			std::function<void()> m_Job{};
+			bool m_Busy{ false };
+			bool m_Stopping{ false };
+			std::thread m_Thread{};
+
+			void Loop();
+		};
+
+		Renderer* m_pRenderer{};
+		Scene* m_pScenes[2]{};
+		uint32_t m_Current{}; //scene of the latest frame handed to the tracer
+		Camera m_Camera{}; //camera after the latest update, the next one continues from it
+		Mode m_Mode{};
+
+		std::vector<uint32_t> m_Buffers[2]{};
+		uint32_t m_BackBuffer{}; //the next resolve goes here, the other one is presented
+
+		mutable std::mutex m_TimingsMutex{};
+		Timings m_Timings{};
+		Clock::time_point m_LastPresent{};
+
+		//The presenter writes the window surface, the calling thread puts it on screen
+		std::mutex m_SurfaceMutex{};
+		bool m_SurfaceChanged{ false };
+		Clock::time_point m_SurfaceUpdateStart{}; //update start of the frame in the window surface
+
+		StageThread m_Tracer{};
+		StageThread m_Presenter{};
+
+		void Update(Scene* pScene, Timer* pTimer);
+		//Trace and resolve on the tracer, then present on the presenter. updateStart is when the update of this frame began
+		void StartTrace(Scene* pScene, Clock::time_point updateStart);
+		//Puts the last frame the presenter copied on screen, if it is not there yet
+		void UpdateWindow();
+	};
+}
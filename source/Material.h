@@ -6,154 +6,123 @@
 namespace dae
 {
 #pragma region Material BASE
-	class Material
+	enum class MaterialType : uint8_t
 	{
-	public:
-		Material() = default;
-		virtual ~Material() = default;
-
-		Material(const Material&) = delete;
-		Material(Material&&) noexcept = delete;
-		Material& operator=(const Material&) = delete;
-		Material& operator=(Material&&) noexcept = delete;
-
-		/**
-		 * \brief Function used to calculate the correct color for the specific material and its parameters
-		 * \param hitRecord current hitrecord
-		 * \param l light direction
-		 * \param v view direction
-		 * \return color
-		 */
-		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) = 0;
+		SolidColor,
+		Lambert,
+		LambertPhong,
+		CookTorrence
 	};
-#pragma endregion
 
-#pragma region Material SOLID COLOR
-	//SOLID COLOR
-	//===========
-	class Material_SolidColor final : public Material
+	//Materials are plain values in one contiguous table owned by the scene, Shade switches on the type instead of a virtual call.
+	//Every term that only depends on the parameters is computed once by the factory functions
+	struct Material
 	{
-	public:
-		Material_SolidColor(const ColorRGB& color): m_Color(color)
-		{
+		MaterialType type{ MaterialType::SolidColor };
 
-		}
+		ColorRGB color{ colors::White }; //SolidColor: the color. Others: the diffuse term, zero for Cook-Torrence metals
+		ColorRGB f0{}; //Cook-Torrence base reflectivity, 0.04 for dielectrics and the albedo for metals
+		float specularReflectance{}; //Phong ks
+		float phongExponent{};
+		float alpha2{}; //Cook-Torrence roughness squared
+		float schlickK{}; //Cook-Torrence (roughness + 1)^2 / 8
 
-		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) override
+		static Material SolidColor(const ColorRGB& color)
 		{
-			return m_Color;
+			Material material{};
+			material.type = MaterialType::SolidColor;
+			material.color = color;
+			return material;
 		}
 
-	private:
-		ColorRGB m_Color{colors::White};
-	};
-
-
-	
-#pragma endregion
-
-#pragma region Material LAMBERT
-	//LAMBERT
-	//=======
-	class Material_Lambert final : public Material
-	{
-	public:
-		Material_Lambert(const ColorRGB& diffuseColor, float diffuseReflectance) :
-			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(diffuseReflectance){}
-
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		/**
+		 * \param diffuseColor Diffuse Color
+		 * \param diffuseReflectance Diffuse Reflection Coefficient (kd)
+		 */
+		static Material Lambert(const ColorRGB& diffuseColor, float diffuseReflectance)
 		{
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor);
+			Material material{};
+			material.type = MaterialType::Lambert;
+			material.color = BRDF::Lambert(diffuseReflectance, diffuseColor);
+			return material;
 		}
 
-	private:
-		ColorRGB m_DiffuseColor{colors::White};
-		float m_DiffuseReflectance{1.f}; //kd
-	};
-#pragma endregion
-
-#pragma region Material LAMBERT PHONG
-	//LAMBERT-PHONG
-	//=============
-	class Material_LambertPhong final : public Material
-	{
-	public:
-		Material_LambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent):
-			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(kd), m_SpecularReflectance(ks),
-			m_PhongExponent(phongExponent)
+		/**
+		 * \param diffuseColor Diffuse Color
+		 * \param kd Diffuse Reflection Coefficient
+		 * \param ks Specular Reflection Coefficient
+		 * \param phongExponent Phong Exponent
+		 */
+		static Material LambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent)
 		{
+			Material material{};
+			material.type = MaterialType::LambertPhong;
+			material.color = BRDF::Lambert(kd, diffuseColor);
+			material.specularReflectance = ks;
+			material.phongExponent = phongExponent;
+			return material;
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		/**
+		 * \param albedo Albedo, also the base reflectivity of metals
+		 * \param metalness 0 for dielectrics, 1 for metals
+		 * \param roughness [1.0 > 0.0] >> [ROUGH > SMOOTH]
+		 */
+		static Material CookTorrence(const ColorRGB& albedo, float metalness, float roughness)
 		{
-			//todo: W3
-			
-
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor) 
-				+ BRDF::Phong(m_SpecularReflectance, m_PhongExponent, l, -v, hitRecord.normal);
-			
-		}
-		
-	private:
-		ColorRGB m_DiffuseColor{colors::White};
-		float m_DiffuseReflectance{0.5f}; //kd
-		float m_SpecularReflectance{0.5f}; //ks
-		float m_PhongExponent{1.f}; //Phong Exponent
-	};
-#pragma endregion
+			Material material{};
+			material.type = MaterialType::CookTorrence;
+			material.f0 = AreEqual(metalness, 0) ? ColorRGB{ 0.04f, 0.04f, 0.04f } : albedo;
+			material.alpha2 = roughness * roughness;
+			material.schlickK = (roughness + 1.0f) * (roughness + 1.0f) / 8.0f;
+
+			material.color = ColorRGB{ 0.f, 0.f, 0.f };
+			if (metalness < 0.5f)
+			{
+				const float LambertianFactor = 1.f / (PI);
+				material.color.r = albedo.r * LambertianFactor;
+				material.color.g = albedo.g * LambertianFactor;
+				material.color.b = albedo.b * LambertianFactor;
+			}
 
-#pragma region Material COOK TORRENCE
-	//COOK TORRENCE
-	class Material_CookTorrence final : public Material
-	{
-	public:
-		Material_CookTorrence(const ColorRGB& albedo, float metalness, float roughness):
-			m_Albedo(albedo), m_Metalness(metalness), m_Roughness(roughness)
-		{
+			return material;
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		/**
+		 * \brief Function used to calculate the correct color for the specific material and its parameters
+		 * \param hitRecord current hitrecord
+		 * \param l light direction
+		 * \param v view direction
+		 * \return color
+		 */
+		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) const
 		{
-			ColorRGB specularComponent(0.0f, 0.0f, 0.0f);
-			ColorRGB diffuseComponent(0.0f, 0.0f, 0.0f);
+			switch (type)
+			{
+			case MaterialType::Lambert:
+				return color;
 
-			Vector3 h = Vector3(v.Normalized() + l.Normalized()).Normalized();
+			case MaterialType::LambertPhong:
+				return color + BRDF::Phong(specularReflectance, phongExponent, l, -v, hitRecord.normal);
 
-			if (AreEqual(m_Metalness, 0)) {
-				ColorRGB f0Dielectric(0.04f, 0.04f, 0.04f);
+			case MaterialType::CookTorrence:
+			{
+				const Vector3 h = Vector3(v.Normalized() + l.Normalized()).Normalized();
 
-				ColorRGB fresnel = BRDF::FresnelFunction_Schlick(hitRecord.normal, v, f0Dielectric);
-				float normalDistribution = BRDF::NormalDistribution_GGX(hitRecord.normal, h, m_Roughness);
-				//float geometry = BRDF::GeometryFunction_SchlickGGX(hitRecord.normal, v, m_Roughness);
-				float geometry = BRDF::GeometryFunction_Smith(hitRecord.normal, v, l, m_Roughness);
+				const ColorRGB fresnel = BRDF::FresnelFunction_Schlick(hitRecord.normal, v, f0);
+				const float normalDistribution = BRDF::NormalDistribution_GGX_Alpha2(hitRecord.normal, h, alpha2);
+				const float geometry = BRDF::GeometryFunction_Smith_K(hitRecord.normal, v, l, schlickK);
 
-				specularComponent += (fresnel * geometry * normalDistribution) / (4 * (Vector3::Dot(v, hitRecord.normal) * (Vector3::Dot(l, hitRecord.normal))));
-			}
-			else {
-				ColorRGB fresnel = BRDF::FresnelFunction_Schlick(hitRecord.normal, v, m_Albedo);
-				float normalDistribution = BRDF::NormalDistribution_GGX(hitRecord.normal, h, m_Roughness);
-				//float geometry = BRDF::GeometryFunction_SchlickGGX(hitRecord.normal, v, m_Roughness);
-				float geometry = BRDF::GeometryFunction_Smith(hitRecord.normal, v, l, m_Roughness);
+				const ColorRGB specularComponent = (fresnel * geometry * normalDistribution) / (4 * (Vector3::Dot(v, hitRecord.normal) * (Vector3::Dot(l, hitRecord.normal))));
 
-				specularComponent += (fresnel * geometry * normalDistribution) / (4 * (Vector3::Dot(v, hitRecord.normal) * (Vector3::Dot(l, hitRecord.normal))));
+				return specularComponent + color;
 			}
 
-			if (m_Metalness < 0.5f) {
-				float LambertianFactor = 1.f / (PI);
-				diffuseComponent.r = m_Albedo.r * LambertianFactor;
-				diffuseComponent.g = m_Albedo.g * LambertianFactor;
-				diffuseComponent.b = m_Albedo.b * LambertianFactor;
-				//diffuseComponent = m_Albedo * LambertianFactor;
+			case MaterialType::SolidColor:
+			default:
+				return color;
 			}
-
-
-			return specularComponent + diffuseComponent;
-		} 
-	
-	private:
-		ColorRGB m_Albedo{0.955f, 0.637f, 0.538f}; //Copper
-		float m_Metalness{1.0f};
-		float m_Roughness{0.1f}; // [1.0 > 0.0] >> [ROUGH > SMOOTH]
+		}
 	};
 #pragma endregion
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <float.h>
 
 namespace dae
@@ -28,4 +30,16 @@ namespace dae
 	{
 		return abs(a - b) < epsilon;
 	}
+
+	//FNV-1a over size bytes, pass the result of a previous call as hash to chain several ranges
+	constexpr uint64_t HashSeed{ 14695981039346656037ull };
+	inline uint64_t HashBytes(const void* pData, size_t size, uint64_t hash = HashSeed)
+	{
+		const unsigned char* pBytes = static_cast<const unsigned char*>(pData);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash = (hash ^ pBytes[i]) * 1099511628211ull;
+		}
+		return hash;
+	}
 }
\ No newline at end of file
@@ -6,55 +6,6 @@
 #include <cmath>
 
 namespace dae {
-	Matrix::Matrix(const Vector3& xAxis, const Vector3& yAxis, const Vector3& zAxis, const Vector3& t) :
-		Matrix({ xAxis, 0 }, { yAxis, 0 }, { zAxis, 0 }, { t, 1 })
-	{
-	}
-
-	Matrix::Matrix(const Vector4& xAxis, const Vector4& yAxis, const Vector4& zAxis, const Vector4& t)
-	{
-		data[0] = xAxis;
-		data[1] = yAxis;
-		data[2] = zAxis;
-		data[3] = t;
-	}
-
-	Matrix::Matrix(const Matrix& m)
-	{
-		data[0] = m[0];
-		data[1] = m[1];
-		data[2] = m[2];
-		data[3] = m[3];
-	}
-
-	Vector3 Matrix::TransformVector(const Vector3& v) const
-	{
-		return TransformVector(v[0], v[1], v[2]);
-	}
-
-	Vector3 Matrix::TransformVector(float x, float y, float z) const
-	{
-		return Vector3{
-			data[0].x * x + data[1].x * y + data[2].x * z,
-			data[0].y * x + data[1].y * y + data[2].y * z,
-			data[0].z * x + data[1].z * y + data[2].z * z
-		};
-	}
-
-	Vector3 Matrix::TransformPoint(const Vector3& p) const
-	{
-		return TransformPoint(p[0], p[1], p[2]);
-	}
-
-	Vector3 Matrix::TransformPoint(float x, float y, float z) const
-	{
-		return Vector3{
-			data[0].x * x + data[1].x * y + data[2].x * z + data[3].x,
-			data[0].y * x + data[1].y * y + data[2].y * z + data[3].y,
-			data[0].z * x + data[1].z * y + data[2].z * z + data[3].z,
-		};
-	}
-
 	const Matrix& Matrix::Transpose()
 	{
 		Matrix result{};
@@ -82,24 +33,48 @@ namespace dae {
 		return out;
 	}
 
-	Vector3 Matrix::GetAxisX() const
+	//Inverse of an affine transform (rotation/scale + translation, last column 0,0,0,1)
+	const Matrix& Matrix::Inverse()
 	{
-		return data[0];
-	}
+		const float det =
+			data[0].x * (data[1].y * data[2].z - data[1].z * data[2].y) -
+			data[0].y * (data[1].x * data[2].z - data[1].z * data[2].x) +
+			data[0].z * (data[1].x * data[2].y - data[1].y * data[2].x);
 
-	Vector3 Matrix::GetAxisY() const
-	{
-		return data[1];
-	}
+		assert(!AreEqual(det, 0.f) && "Matrix is not invertible");
+		const float invDet = 1.f / det;
 
-	Vector3 Matrix::GetAxisZ() const
-	{
-		return data[2];
+		Matrix result{};
+		result[0][0] = (data[1].y * data[2].z - data[1].z * data[2].y) * invDet;
+		result[0][1] = (data[0].z * data[2].y - data[0].y * data[2].z) * invDet;
+		result[0][2] = (data[0].y * data[1].z - data[0].z * data[1].y) * invDet;
+
+		result[1][0] = (data[1].z * data[2].x - data[1].x * data[2].z) * invDet;
+		result[1][1] = (data[0].x * data[2].z - data[0].z * data[2].x) * invDet;
+		result[1][2] = (data[0].z * data[1].x - data[0].x * data[1].z) * invDet;
+
+		result[2][0] = (data[1].x * data[2].y - data[1].y * data[2].x) * invDet;
+		result[2][1] = (data[0].y * data[2].x - data[0].x * data[2].y) * invDet;
+		result[2][2] = (data[0].x * data[1].y - data[0].y * data[1].x) * invDet;
+
+		//Row vectors: p' = p * A + t  >>  p = (p' - t) * A^-1
+		const Vector3 translation = -result.TransformVector(data[3].x, data[3].y, data[3].z);
+		result[3] = { translation, 1.f };
+
+		data[0] = result[0];
+		data[1] = result[1];
+		data[2] = result[2];
+		data[3] = result[3];
+
+		return *this;
 	}
 
-	Vector3 Matrix::GetTranslation() const
+	Matrix Matrix::Inverse(const Matrix& m)
 	{
-		return data[3];
+		Matrix out{ m };
+		out.Inverse();
+
+		return out;
 	}
 
 	Matrix Matrix::CreateTranslation(float x, float y, float z)
@@ -191,18 +166,6 @@ namespace dae {
 	}
 
 #pragma region Operator Overloads
-	Vector4& Matrix::operator[](int index)
-	{
-		assert(index <= 3 && index >= 0);
-		return data[index];
-	}
-
-	Vector4 Matrix::operator[](int index) const
-	{
-		assert(index <= 3 && index >= 0);
-		return data[index];
-	}
-
 	Matrix Matrix::operator*(const Matrix& m) const
 	{
 		Matrix result{};
@@ -1,8 +1,13 @@
 #pragma once
+#include <cassert>
+#include <cstddef>
+#include <immintrin.h>
+
 #include "Vector3.h"
 #include "Vector4.h"
 
 namespace dae {
+	//The per-ray and per-vertex members are defined here so they inline, building and combining matrices stays in Matrix.cpp
 	struct Matrix
 	{
 		Matrix() = default;
@@ -10,26 +15,89 @@ namespace dae {
 			const Vector3& xAxis,
 			const Vector3& yAxis,
 			const Vector3& zAxis,
-			const Vector3& t);
+			const Vector3& t) :
+			Matrix({ xAxis, 0 }, { yAxis, 0 }, { zAxis, 0 }, { t, 1 })
+		{
+		}
 
 		Matrix(
 			const Vector4& xAxis,
 			const Vector4& yAxis,
 			const Vector4& zAxis,
-			const Vector4& t);
+			const Vector4& t)
+		{
+			data[0] = xAxis;
+			data[1] = yAxis;
+			data[2] = zAxis;
+			data[3] = t;
+		}
 
-		Matrix(const Matrix& m);
+		Matrix(const Matrix& m)
+		{
+			data[0] = m.data[0];
+			data[1] = m.data[1];
+			data[2] = m.data[2];
+			data[3] = m.data[3];
+		}
+
+		Vector3 TransformVector(const Vector3& v) const
+		{
+			return TransformVector(v.x, v.y, v.z);
+		}
+
+		Vector3 TransformVector(float x, float y, float z) const
+		{
+			return Vector3{
+				data[0].x * x + data[1].x * y + data[2].x * z,
+				data[0].y * x + data[1].y * y + data[2].y * z,
+				data[0].z * x + data[1].z * y + data[2].z * z
+			};
+		}
+
+		Vector3 TransformPoint(const Vector3& p) const
+		{
+			return TransformPoint(p.x, p.y, p.z);
+		}
+
+		Vector3 TransformPoint(float x, float y, float z) const
+		{
+			return Vector3{
+				data[0].x * x + data[1].x * y + data[2].x * z + data[3].x,
+				data[0].y * x + data[1].y * y + data[2].y * z + data[3].y,
+				data[0].z * x + data[1].z * y + data[2].z * z + data[3].z,
+			};
+		}
+
+		//TransformPoint over a whole array, one SSE register per point holding x * row0 + y * row1 + z * row2 + row3.
+		//Same operation order as TransformPoint so both give the same result. pPoints and pResult may be the same array
+		void TransformPoints(const Vector3* pPoints, Vector3* pResult, size_t count) const
+		{
+			const __m128 row0 = _mm_loadu_ps(&data[0].x);
+			const __m128 row1 = _mm_loadu_ps(&data[1].x);
+			const __m128 row2 = _mm_loadu_ps(&data[2].x);
+			const __m128 row3 = _mm_loadu_ps(&data[3].x);
+
+			for (size_t i{ 0 }; i < count; ++i)
+			{
+				const Vector3& p = pPoints[i];
+
+				__m128 result = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x), row0), _mm_mul_ps(_mm_set1_ps(p.y), row1));
+				result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(p.z), row2));
+				result = _mm_add_ps(result, row3);
+
+				//x and y as one 8 byte store, then z, a 16 byte store would run into the next point
+				_mm_storel_pi(reinterpret_cast<__m64*>(&pResult[i].x), result);
+				_mm_store_ss(&pResult[i].z, _mm_movehl_ps(result, result));
+			}
+		}
 
-		Vector3 TransformVector(const Vector3& v) const;
-		Vector3 TransformVector(float x, float y, float z) const;
-		Vector3 TransformPoint(const Vector3& p) const;
-		Vector3 TransformPoint(float x, float y, float z) const;
 		const Matrix& Transpose();
+		const Matrix& Inverse();
 
-		Vector3 GetAxisX() const;
-		Vector3 GetAxisY() const;
-		Vector3 GetAxisZ() const;
-		Vector3 GetTranslation() const;
+		Vector3 GetAxisX() const { return { data[0].x, data[0].y, data[0].z }; }
+		Vector3 GetAxisY() const { return { data[1].x, data[1].y, data[1].z }; }
+		Vector3 GetAxisZ() const { return { data[2].x, data[2].y, data[2].z }; }
+		Vector3 GetTranslation() const { return { data[3].x, data[3].y, data[3].z }; }
 
 		static Matrix CreateTranslation(float x, float y, float z);
 		static Matrix CreateTranslation(const Vector3& t);
@@ -41,9 +109,20 @@ namespace dae {
 		static Matrix CreateScale(float sx, float sy, float sz);
 		static Matrix CreateScale(const Vector3& s);
 		static Matrix Transpose(const Matrix& m);
+		static Matrix Inverse(const Matrix& m);
+
+		Vector4& operator[](int index)
+		{
+			assert(index <= 3 && index >= 0);
+			return data[index];
+		}
+
+		Vector4 operator[](int index) const
+		{
+			assert(index <= 3 && index >= 0);
+			return data[index];
+		}
 
-		Vector4& operator[](int index);
-		Vector4 operator[](int index) const;
 		Matrix operator*(const Matrix& m) const;
 		const Matrix& operator*=(const Matrix& m);
 
@@ -8,156 +8,1030 @@
 #include "Matrix.h"
 #include "Material.h"
 #include "Scene.h"
+#include "ThreadPool.h"
 #include "Utils.h"
 
-#include <execution>
+#include <algorithm>
+#include <chrono>
+#include <immintrin.h>
 
 using namespace dae;
 
 #define PARRALEL_EXECUTION
+//Trace primary rays as RayPacket blocks instead of pixel by pixel
+#define PACKET_TRACING
 
-Renderer::Renderer(SDL_Window * pWindow) :
+Renderer::Renderer(SDL_Window * pWindow, const ThreadPool::Configuration& threads) :
 	m_pWindow(pWindow),
 	m_pBuffer(SDL_GetWindowSurface(pWindow))
 {
 	//Initialize
-	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
+	SDL_GetWindowSize(pWindow, &m_WindowWidth, &m_WindowHeight);
 	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
 
-	
+	//32-bit formats with 8 bits per channel are packed with shifts, anything else goes through SDL_MapRGB
+	const SDL_PixelFormat* pFormat = m_pBuffer->format;
+	m_PackWithShifts = pFormat->BytesPerPixel == 4 && pFormat->Rloss == 0 && pFormat->Gloss == 0 && pFormat->Bloss == 0;
+	m_RedShift = pFormat->Rshift;
+	m_GreenShift = pFormat->Gshift;
+	m_BlueShift = pFormat->Bshift;
+	m_AlphaMask = pFormat->Amask;
+
+	ConfigureThreads(threads);
+	ResizeFrame(m_WindowWidth, m_WindowHeight);
 }
 
-void Renderer::Render(Scene* pScene) const
+Renderer::~Renderer() = default;
+
+void Renderer::ConfigureThreads(const ThreadPool::Configuration& configuration)
 {
-	Camera& camera = pScene->GetCamera();
-	auto& materials = pScene->GetMaterials();
-	auto& lights = pScene->GetLights();
-	float offset = 0.5f;
-	float aspectRatio = static_cast<float>(m_Width) / static_cast<float>(m_Height);
+#if defined(PARRALEL_EXECUTION)
+	m_pThreadPool = std::make_unique<ThreadPool>(configuration);
+#else
+	ThreadPool::Configuration singleThread{ configuration };
+	singleThread.threadCount = 1;
+	m_pThreadPool = std::make_unique<ThreadPool>(singleThread);
+#endif
 
-	float fov = tanf(camera.fovAngle * TO_RADIANS / 2);
-	const Matrix cameraToWorld = camera.CalculateCameraToWorld();
+	//Scratch buffers are per worker
+	m_UpscaleRows.assign(m_pThreadPool->GetThreadCount(), std::vector<float>(size_t(m_WindowWidth) * 3));
+	UpdateTiles();
+}
 
+uint32_t Renderer::GetThreadCount() const
+{
+	return m_pThreadPool->GetThreadCount();
+}
 
+const std::vector<uint32_t>& Renderer::GetThreadProcessors() const
+{
+	return m_pThreadPool->GetProcessors();
+}
 
+void Renderer::SetTileSize(uint32_t tileSize)
+{
+	const uint32_t packetSize{ std::max(RayPacket::Width, RayPacket::Height) };
+	m_TileSize = (std::max(tileSize, 1u) + packetSize - 1) / packetSize * packetSize;
+	UpdateTiles();
+}
 
-#if defined(PARRALEL_EXECUTION)
-	uint32_t amountOfPixels{ uint32_t(m_Width * m_Height) };
-	std::vector<uint32_t> pixelIndices{};
+void Renderer::UpdateTiles()
+{
+	const uint32_t tilesPerRow{ (uint32_t(m_Width) + m_TileSize - 1) / m_TileSize };
+	const uint32_t tileRows{ (uint32_t(m_Height) + m_TileSize - 1) / m_TileSize };
 
-	pixelIndices.reserve(amountOfPixels);
+	//Interleaves the bits of x and y, tiles next to each other in the order are next to each other on screen
+	const auto mortonCode = [](uint32_t x, uint32_t y)
+		{
+			uint64_t code{};
+			for (uint32_t bit{ 0 }; bit < 16; ++bit)
+			{
+				code |= uint64_t((x >> bit) & 1) << (2 * bit);
+				code |= uint64_t((y >> bit) & 1) << (2 * bit + 1);
+			}
+			return code;
+		};
 
-	for (uint32_t index{}; index < amountOfPixels; index++)
+	m_TileOrder.clear();
+	m_TileOrder.reserve(size_t(tilesPerRow) * tileRows);
+	for (uint32_t y{ 0 }; y < tileRows; ++y)
 	{
-		pixelIndices.emplace_back(index);
+		for (uint32_t x{ 0 }; x < tilesPerRow; ++x)
+		{
+			m_TileOrder.emplace_back(x | (y << 16));
+		}
 	}
 
-	std::for_each(std::execution::par, pixelIndices.begin(), pixelIndices.end(), [&](int i) {
-		RenderPixel(pScene, i, fov, aspectRatio, cameraToWorld, camera.origin);
+	std::sort(m_TileOrder.begin(), m_TileOrder.end(), [&](uint32_t a, uint32_t b)
+		{
+			return mortonCode(a & 0xFFFF, a >> 16) < mortonCode(b & 0xFFFF, b >> 16);
 		});
 
-#else
-	uint32_t amountOfPixels{ uint32_t(m_Width * m_Height) };
-	for (uint32_t index{}; index < amountOfPixels; index++)
+	m_TileBuffers.resize(m_pThreadPool->GetThreadCount());
+	for (TileBuffer& tile : m_TileBuffers)
 	{
-		RenderPixel(pScene, index, fov, aspectRatio, cameraToWorld, camera.origin);
+		tile.size = m_TileSize;
+		tile.red.resize(size_t(m_TileSize) * m_TileSize);
+		tile.green.resize(size_t(m_TileSize) * m_TileSize);
+		tile.blue.resize(size_t(m_TileSize) * m_TileSize);
 	}
-#endif
-	
-	//@END
+}
+
+void Renderer::Render(Scene* pScene)
+{
+	Trace(pScene);
+	Resolve(m_pBufferPixels);
+	UpdateWindow();
+}
+
+void Renderer::Trace(Scene* pScene)
+{
+	UpdateRenderScale();
+	UpdateInvariants(pScene);
+
+	DispatchKernel([&]<LightingMode Mode, bool ShadowsEnabled>()
+		{
+			if (m_ProgressiveEnabled)
+				RenderProgressive<Mode, ShadowsEnabled>(pScene);
+			else if (m_WavefrontEnabled)
+				RenderWavefront<Mode, ShadowsEnabled>(pScene);
+			else
+				RenderFrame<Mode, ShadowsEnabled>(pScene);
+		});
+}
+
+void Renderer::Present(const uint32_t* pPixels)
+{
+	if (pPixels != m_pBufferPixels)
+		std::copy_n(pPixels, GetPixelCount(), m_pBufferPixels);
+}
+
+void Renderer::UpdateWindow()
+{
 	//Update SDL Surface
 	SDL_UpdateWindowSurface(m_pWindow);
 }
 
-void Renderer::RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Matrix cameraToWorld, const Vector3 cameraOrigin) const
+void Renderer::UpdateRenderScale()
 {
-	auto materials{ pScene->GetMaterials() };
+	if (!m_DynamicResolutionEnabled)
+	{
+		m_RenderScale = 1.f;
+		m_AverageFrameTime = 0.f;
+		ResizeFrame(m_WindowWidth, m_WindowHeight);
+		return;
+	}
 
-	const uint32_t px{ pixelIndex % m_Width }, py{ pixelIndex / m_Width};
-	float rx{ px + 0.5f }, ry{ py + 0.5f };
-	float cx{ (2 * (rx / float(m_Width)) - 1) * aspectRatio * fov };
-	float cy{ (1 - (2 * (ry / float(m_Height)))) * fov };
+	const float frameTime{ m_ReportedFrameTime.exchange(0.f, std::memory_order_relaxed) };
+	if (frameTime <= 0.f)
+		return;
 
+	//Smoothed so a single slow frame does not drop the resolution
+	m_AverageFrameTime = m_AverageFrameTime > 0.f ? Lerpf(m_AverageFrameTime, frameTime, 0.25f) : frameTime;
 
-	auto& lights = pScene->GetLights();
+	//The cost of a frame follows its pixel count, the square of the scale. Within 10% of the target nothing changes,
+	//so the resolution does not flicker between two steps, and one frame moves the scale by at most 25%
+	const float ratio{ 1.f / (m_TargetFPS * m_AverageFrameTime) };
+	if (ratio > 0.9f && ratio < 1.1f)
+		return;
 
-	Vector3 rayDirection = { cx, cy, 1 };
-	rayDirection.Normalize();
+	m_RenderScale = std::clamp(m_RenderScale * std::clamp(sqrtf(ratio), 0.8f, 1.25f), MinRenderScale, 1.f);
+
+	const int width{ std::max(static_cast<int>(m_WindowWidth * m_RenderScale + 0.5f), 2) };
+	const int height{ std::max(static_cast<int>(m_WindowHeight * m_RenderScale + 0.5f), 2) };
+	if (width != m_Width || height != m_Height)
+	{
+		//The frames measured so far were at the old resolution
+		m_AverageFrameTime = 0.f;
+		ResizeFrame(width, height);
+	}
+}
+
+void Renderer::ResizeFrame(int width, int height)
+{
+	if (width == m_Width && height == m_Height)
+		return;
+
+	m_Width = width;
+	m_Height = height;
+
+	const size_t amountOfPixels{ size_t(m_Width) * size_t(m_Height) };
+	m_FrameRed.assign(amountOfPixels, 0.f);
+	m_FrameGreen.assign(amountOfPixels, 0.f);
+	m_FrameBlue.assign(amountOfPixels, 0.f);
+
+	UpdateTiles();
+
+	//Pixel centers of the window mapped onto the frame, clamped so the footprint never leaves it
+	const float scaleX{ static_cast<float>(m_Width) / static_cast<float>(m_WindowWidth) };
+	m_UpscaleColumns.resize(m_WindowWidth);
+	m_UpscaleWeights.resize(m_WindowWidth);
+	for (int x{ 0 }; x < m_WindowWidth; ++x)
+	{
+		const float column{ std::clamp((x + 0.5f) * scaleX - 0.5f, 0.f, static_cast<float>(m_Width - 1)) };
+		const uint32_t left{ std::min(static_cast<uint32_t>(column), static_cast<uint32_t>(m_Width - 2)) };
+		m_UpscaleColumns[x] = left;
+		m_UpscaleWeights[x] = column - static_cast<float>(left);
+	}
+
+	for (std::vector<float>& upscaledRow : m_UpscaleRows)
+	{
+		upscaledRow.resize(size_t(m_WindowWidth) * 3);
+	}
+}
 
-	rayDirection = cameraToWorld.TransformVector(rayDirection);
+void Renderer::UpdateInvariants(Scene* pScene)
+{
+	pScene->UpdatePointInvariants(pScene->GetCamera().origin, m_CameraInvariants);
+
+	const LightPool& lightPool = pScene->GetLightPool();
+	m_LightInvariants.resize(lightPool.count);
+	for (uint32_t i = 0; i < lightPool.count; ++i)
+	{
+		if (lightPool.positional[i] > 0.f)
+			pScene->UpdatePointInvariants({ lightPool.x[i], lightPool.y[i], lightPool.z[i] }, m_LightInvariants[i]);
+	}
+}
+
+template<typename Function>
+void Renderer::DispatchKernel(Function&& function) const
+{
+	const auto dispatchShadows = [&]<LightingMode Mode>()
+		{
+			if (m_ShadowEnabled)
+				function.template operator()<Mode, true>();
+			else
+				function.template operator()<Mode, false>();
+		};
+
+	switch (m_CurrentLightingMode)
+	{
+	case LightingMode::ObservedArea:
+		dispatchShadows.template operator()<LightingMode::ObservedArea>();
+		break;
+	case LightingMode::Radiance:
+		dispatchShadows.template operator()<LightingMode::Radiance>();
+		break;
+	case LightingMode::BRDF:
+		dispatchShadows.template operator()<LightingMode::BRDF>();
+		break;
+	case LightingMode::Combined:
+		dispatchShadows.template operator()<LightingMode::Combined>();
+		break;
+	}
+}
+
+template<Renderer::LightingMode Mode, bool ShadowsEnabled>
+void Renderer::RenderFrame(Scene* pScene)
+{
+	Camera& camera = pScene->GetCamera();
+	float aspectRatio = static_cast<float>(m_Width) / static_cast<float>(m_Height);
+
+	float fov = tanf(camera.fovAngle * TO_RADIANS / 2);
+	const Matrix cameraToWorld = camera.CalculateCameraToWorld();
+
+	m_pThreadPool->Run(static_cast<uint32_t>(m_TileOrder.size()), [&](uint32_t tileIndex, uint32_t worker)
+		{
+			RenderTile<Mode, ShadowsEnabled>(pScene, tileIndex, m_TileBuffers[worker], fov, aspectRatio, cameraToWorld, camera.origin);
+		});
+
+	const ThreadPool::Statistics& statistics = m_pThreadPool->GetStatistics();
+	m_TileStatistics.wall = statistics.wall;
+	m_TileStatistics.overhead = statistics.overhead;
+	m_TileStatistics.imbalance = statistics.imbalance;
+	m_TileStatistics.tiles = statistics.tasks;
+	m_TileStatistics.steals = statistics.steals;
+	m_TileStatistics.threads = m_pThreadPool->GetThreadCount();
+}
+
+template<Renderer::LightingMode Mode, bool ShadowsEnabled>
+void Renderer::RenderTile(Scene* pScene, uint32_t tileIndex, TileBuffer& tile, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin) const
+{
+	tile.firstX = (m_TileOrder[tileIndex] & 0xFFFF) * m_TileSize;
+	tile.firstY = (m_TileOrder[tileIndex] >> 16) * m_TileSize;
+	const uint32_t lastX{ std::min(tile.firstX + m_TileSize, uint32_t(m_Width)) };
+	const uint32_t lastY{ std::min(tile.firstY + m_TileSize, uint32_t(m_Height)) };
+
+#if defined(PACKET_TRACING)
+	for (uint32_t py{ tile.firstY }; py < lastY; py += RayPacket::Height)
+	{
+		for (uint32_t px{ tile.firstX }; px < lastX; px += RayPacket::Width)
+		{
+			RenderPacket<Mode, ShadowsEnabled>(pScene, px, py, tile, fov, aspectRatio, cameraToWorld, cameraOrigin);
+		}
+	}
+#else
+	for (uint32_t py{ tile.firstY }; py < lastY; ++py)
+	{
+		for (uint32_t px{ tile.firstX }; px < lastX; ++px)
+		{
+			RenderPixel<Mode, ShadowsEnabled>(pScene, px, py, tile, fov, aspectRatio, cameraToWorld, cameraOrigin);
+		}
+	}
+#endif
+
+	//One copy per tile row into the frame
+	const uint32_t rowLength{ lastX - tile.firstX };
+	for (uint32_t py{ tile.firstY }; py < lastY; ++py)
+	{
+		const uint32_t tileRow{ (py - tile.firstY) * tile.size };
+		const uint32_t frameRow{ tile.firstX + py * uint32_t(m_Width) };
+		std::copy_n(&tile.red[tileRow], rowLength, &m_FrameRed[frameRow]);
+		std::copy_n(&tile.green[tileRow], rowLength, &m_FrameGreen[frameRow]);
+		std::copy_n(&tile.blue[tileRow], rowLength, &m_FrameBlue[frameRow]);
+	}
+}
+
+template<Renderer::LightingMode Mode, bool ShadowsEnabled>
+void Renderer::RenderPixel(Scene* pScene, uint32_t px, uint32_t py, TileBuffer& tile, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin) const
+{
+	const Vector3 rayDirection = GetPrimaryRayDirection(px, py, fov, aspectRatio, cameraToWorld);
 
 	Ray viewRay{ cameraOrigin, rayDirection };
 
 	HitRecord closestHit{};
-	pScene->GetClosestHit(viewRay, closestHit);
+	pScene->GetClosestHit(viewRay, closestHit, &m_CameraInvariants);
+
+	tile.Write(px, py, ShadePixel<Mode, ShadowsEnabled>(pScene, rayDirection, closestHit));
+}
+
+template<Renderer::LightingMode Mode, bool ShadowsEnabled>
+void Renderer::RenderPacket(Scene* pScene, uint32_t firstX, uint32_t firstY, TileBuffer& tile, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin) const
+{
+	RayPacket packet{};
+	packet.origin = cameraOrigin;
+
+	//Lanes that fall outside the image stay out of the mask
+	for (uint32_t lane{ 0 }; lane < RayPacket::Size; ++lane)
+	{
+		const uint32_t px{ firstX + lane % RayPacket::Width }, py{ firstY + lane / RayPacket::Width };
+		if (px < uint32_t(m_Width) && py < uint32_t(m_Height))
+			packet.SetRay(lane, GetPrimaryRayDirection(px, py, fov, aspectRatio, cameraToWorld));
+	}
+
+	packet.Prepare();
+
+	HitRecord closestHits[RayPacket::Size]{};
+	pScene->GetClosestHits(packet, closestHits, &m_CameraInvariants);
+
+	for (uint32_t lanes{ packet.mask }; lanes != 0; lanes &= lanes - 1)
+	{
+		const uint32_t lane = static_cast<uint32_t>(std::countr_zero(lanes));
+		const Vector3 rayDirection{ packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane] };
+
+		tile.Write(firstX + lane % RayPacket::Width, firstY + lane / RayPacket::Width, ShadePixel<Mode, ShadowsEnabled>(pScene, rayDirection, closestHits[lane]));
+	}
+}
+
+template<Renderer::LightingMode Mode, bool ShadowsEnabled>
+void Renderer::RenderProgressive(Scene* pScene)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	const Clock::time_point start = Clock::now();
+
+	Camera& camera = pScene->GetCamera();
+	const float aspectRatio = static_cast<float>(m_Width) / static_cast<float>(m_Height);
+	const float fov = tanf(camera.fovAngle * TO_RADIANS / 2);
+	const Matrix cameraToWorld = camera.CalculateCameraToWorld();
 
+	//Anything that changes the image, the render resolution included, starts a new one
+	const uint32_t settings[]{ uint32_t(Mode), ShadowsEnabled, uint32_t(m_Width), uint32_t(m_Height) };
+	uint64_t key{ pScene->GetContentHash() };
+	key = HashBytes(&cameraToWorld, sizeof(Matrix), key);
+	key = HashBytes(&fov, sizeof(float), key);
+	key = HashBytes(settings, sizeof(settings), key);
+	if (key != m_ProgressiveKey)
+	{
+		m_ProgressiveKey = key;
+		m_ProgressivePass = 0;
+	}
+
+	m_ProgressiveStatistics.passes = 0;
+	while (m_ProgressivePass < ProgressivePasses)
+	{
+		const Clock::time_point passStart = Clock::now();
+		const float elapsed = std::chrono::duration<float, std::milli>(passStart - start).count();
+		if (m_ProgressivePass > 0 && elapsed + m_ProgressiveStatistics.passTime > m_FrameBudget)
+			break;
+
+		const ProgressiveSample& sample = ProgressiveSamples[m_ProgressivePass];
+		m_pThreadPool->Run(static_cast<uint32_t>(m_TileOrder.size()), [&](uint32_t tileIndex, uint32_t)
+			{
+				RenderProgressiveTile<Mode, ShadowsEnabled>(pScene, tileIndex, sample, fov, aspectRatio, cameraToWorld, camera.origin);
+			});
+
+		m_ProgressiveStatistics.passTime = std::chrono::duration<float, std::milli>(Clock::now() - passStart).count();
+		++m_ProgressiveStatistics.passes;
+		++m_ProgressivePass;
+	}
+	m_ProgressiveStatistics.refined = m_ProgressivePass;
+}
+
+template<Renderer::LightingMode Mode, bool ShadowsEnabled>
+void Renderer::RenderProgressiveTile(Scene* pScene, uint32_t tileIndex, const ProgressiveSample& sample, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin) const
+{
+	//Tiles are a multiple of the packet size, so they hold whole blocks
+	const uint32_t firstX{ (m_TileOrder[tileIndex] & 0xFFFF) * m_TileSize };
+	const uint32_t firstY{ (m_TileOrder[tileIndex] >> 16) * m_TileSize };
+	const uint32_t lastX{ std::min(firstX + m_TileSize, uint32_t(m_Width)) };
+	const uint32_t lastY{ std::min(firstY + m_TileSize, uint32_t(m_Height)) };
+
+	const uint32_t blocksPerRow{ (lastX - firstX + ProgressiveBlock - 1) / ProgressiveBlock };
+	const uint32_t blockCount{ blocksPerRow * ((lastY - firstY + ProgressiveBlock - 1) / ProgressiveBlock) };
+
+	for (uint32_t firstBlock{ 0 }; firstBlock < blockCount; firstBlock += RayPacket::Size)
+	{
+		RayPacket packet{};
+		packet.origin = cameraOrigin;
+
+		uint32_t samplesX[RayPacket::Size]{}, samplesY[RayPacket::Size]{};
+		for (uint32_t lane{ 0 }; lane < RayPacket::Size && firstBlock + lane < blockCount; ++lane)
+		{
+			const uint32_t block{ firstBlock + lane };
+			samplesX[lane] = firstX + (block % blocksPerRow) * ProgressiveBlock + sample.x;
+			samplesY[lane] = firstY + (block / blocksPerRow) * ProgressiveBlock + sample.y;
+			if (samplesX[lane] < lastX && samplesY[lane] < lastY)
+				packet.SetRay(lane, GetPrimaryRayDirection(samplesX[lane], samplesY[lane], fov, aspectRatio, cameraToWorld));
+		}
+
+		packet.Prepare();
+
+		HitRecord closestHits[RayPacket::Size]{};
+		pScene->GetClosestHits(packet, closestHits, &m_CameraInvariants);
+
+		for (uint32_t lanes{ packet.mask }; lanes != 0; lanes &= lanes - 1)
+		{
+			const uint32_t lane = static_cast<uint32_t>(std::countr_zero(lanes));
+			const Vector3 rayDirection{ packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane] };
+			const ColorRGB finalColor = ShadePixel<Mode, ShadowsEnabled>(pScene, rayDirection, closestHits[lane]);
+
+			//Passes never fill over a pixel an earlier pass traced
+			for (uint32_t py{ samplesY[lane] }; py < std::min(samplesY[lane] + sample.size, lastY); ++py)
+			{
+				for (uint32_t px{ samplesX[lane] }; px < std::min(samplesX[lane] + sample.size, lastX); ++px)
+				{
+					WritePixel(px + py * uint32_t(m_Width), finalColor);
+				}
+			}
+		}
+	}
+}
+
+Vector3 Renderer::GetPrimaryRayDirection(uint32_t px, uint32_t py, float fov, float aspectRatio, const Matrix& cameraToWorld) const
+{
+	float rx{ px + 0.5f }, ry{ py + 0.5f };
+	float cx{ (2 * (rx / float(m_Width)) - 1) * aspectRatio * fov };
+	float cy{ (1 - (2 * (ry / float(m_Height)))) * fov };
+
+	Vector3 rayDirection = { cx, cy, 1 };
+	rayDirection.Normalize();
+
+	return cameraToWorld.TransformVector(rayDirection);
+}
+
+template<Renderer::LightingMode Mode, bool ShadowsEnabled>
+ColorRGB Renderer::ShadePixel(Scene* pScene, const Vector3& rayDirection, const HitRecord& closestHit) const
+{
+	const auto& materials = pScene->GetMaterials();
+	const LightPool& lightPool = pScene->GetLightPool();
 
 	ColorRGB finalColor{ 0,0,0 };
 	if (closestHit.didHit)
 	{
-		for (const auto& Light : lights)
+		const Material& material = materials[closestHit.materialIndex];
+		LightGroupShading shading{};
+
+		for (uint32_t group{ 0 }; group < lightPool.GroupCount(); ++group)
 		{
-			Ray lightRay{};
-			Vector3 lightRayDirection = LightUtils::GetDirectionToLight(Light, closestHit.origin);
+			ShadeLightGroup<Mode>(lightPool, group, material, closestHit, rayDirection, shading);
+			GatherLightGroup<ShadowsEnabled>(pScene, group, shading, closestHit, finalColor);
+		}
+	}
+
+	return finalColor;
+}
+
+Ray Renderer::GetShadowRay(const LightPool& lightPool, uint32_t lightIndex, const HitRecord& closestHit) const
+{
+	const float positional{ lightPool.positional[lightIndex] };
+	Vector3 lightRayDirection{
+		lightPool.x[lightIndex] - positional * closestHit.origin.x,
+		lightPool.y[lightIndex] - positional * closestHit.origin.y,
+		lightPool.z[lightIndex] - positional * closestHit.origin.z };
+
+	//Shadow rays stop at the light, occluders behind it do not count
+	Ray lightRay{};
+	const float lightDistance = lightRayDirection.Normalize();
+	lightRay.origin = closestHit.origin;
+	lightRay.direction = lightRayDirection;
+	if (positional > 0.f)
+		lightRay.max = lightDistance;
+
+	return lightRay;
+}
+
+template<Renderer::LightingMode Mode>
+void Renderer::ShadeLightGroup(const LightPool& lightPool, uint32_t group, const Material& material, const HitRecord& closestHit, const Vector3& rayDirection, LightGroupShading& shading) const
+{
+	const uint32_t first{ group * LightPool::GroupSize };
+	const uint32_t lanes{ lightPool.GroupLanes(group) };
+	const Vector3& normal = closestHit.normal;
+	const Vector3 view = -rayDirection;
 
-			lightRayDirection.Normalize();
-			lightRay.origin = closestHit.origin;
-			lightRay.direction = lightRayDirection;
+#if defined(__AVX2__)
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.f);
 
-			float lambert = Vector3::Dot(closestHit.normal, lightRayDirection);
+	//Direction and distance to all 8 lights, directional lights have positional 0 and a unit direction
+	const __m256 positional = _mm256_loadu_ps(&lightPool.positional[first]);
+	const __m256 toLightX = _mm256_sub_ps(_mm256_loadu_ps(&lightPool.x[first]), _mm256_mul_ps(positional, _mm256_set1_ps(closestHit.origin.x)));
+	const __m256 toLightY = _mm256_sub_ps(_mm256_loadu_ps(&lightPool.y[first]), _mm256_mul_ps(positional, _mm256_set1_ps(closestHit.origin.y)));
+	const __m256 toLightZ = _mm256_sub_ps(_mm256_loadu_ps(&lightPool.z[first]), _mm256_mul_ps(positional, _mm256_set1_ps(closestHit.origin.z)));
 
-			
+	const __m256 squaredDistance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toLightX, toLightX), _mm256_mul_ps(toLightY, toLightY)), _mm256_mul_ps(toLightZ, toLightZ));
+	const __m256 distance = _mm256_sqrt_ps(squaredDistance);
+	const __m256 lightX = _mm256_div_ps(toLightX, distance);
+	const __m256 lightY = _mm256_div_ps(toLightY, distance);
+	const __m256 lightZ = _mm256_div_ps(toLightZ, distance);
 
-			if (lambert > 0.0f)
+	const __m256 normalX = _mm256_set1_ps(normal.x);
+	const __m256 normalY = _mm256_set1_ps(normal.y);
+	const __m256 normalZ = _mm256_set1_ps(normal.z);
+	const __m256 lambert = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(normalX, lightX), _mm256_mul_ps(normalY, lightY)), _mm256_mul_ps(normalZ, lightZ));
+
+	//Only lights in front of the surface add anything, except for the radiance view which shows every light
+	__m256 contributing = _mm256_cmp_ps(_mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f), _mm256_set1_ps(float(lanes)), _CMP_LT_OQ);
+	if constexpr (Mode != LightingMode::Radiance)
+		contributing = _mm256_and_ps(contributing, _mm256_cmp_ps(lambert, zero, _CMP_GT_OQ));
+
+	__m256 red{ lambert }, green{ lambert }, blue{ lambert };
+
+	if constexpr (Mode != LightingMode::ObservedArea)
+	{
+		__m256 radianceRed{ one }, radianceGreen{ one }, radianceBlue{ one };
+		if constexpr (Mode != LightingMode::BRDF)
+		{
+			//Point lights fall off with the squared distance, directional lights keep their radiant intensity
+			const __m256 falloff = _mm256_blendv_ps(one, squaredDistance, _mm256_cmp_ps(positional, zero, _CMP_GT_OQ));
+			radianceRed = _mm256_div_ps(_mm256_loadu_ps(&lightPool.red[first]), falloff);
+			radianceGreen = _mm256_div_ps(_mm256_loadu_ps(&lightPool.green[first]), falloff);
+			radianceBlue = _mm256_div_ps(_mm256_loadu_ps(&lightPool.blue[first]), falloff);
+		}
+
+		__m256 brdfRed{ one }, brdfGreen{ one }, brdfBlue{ one };
+		if constexpr (Mode != LightingMode::Radiance)
+		{
+			brdfRed = _mm256_set1_ps(material.color.r);
+			brdfGreen = _mm256_set1_ps(material.color.g);
+			brdfBlue = _mm256_set1_ps(material.color.b);
+
+			if (material.type == MaterialType::LambertPhong)
 			{
-				ColorRGB lightShading = materials[closestHit.materialIndex]->Shade(closestHit, lightRayDirection, -rayDirection);
+				//Reflect the light direction about the normal, the specular lobe is around the ray direction
+				const __m256 twoLambert = _mm256_add_ps(lambert, lambert);
+				const __m256 reflectionX = _mm256_sub_ps(lightX, _mm256_mul_ps(twoLambert, normalX));
+				const __m256 reflectionY = _mm256_sub_ps(lightY, _mm256_mul_ps(twoLambert, normalY));
+				const __m256 reflectionZ = _mm256_sub_ps(lightZ, _mm256_mul_ps(twoLambert, normalZ));
+				const __m256 dotRV = _mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(reflectionX, _mm256_set1_ps(rayDirection.x)),
+					_mm256_mul_ps(reflectionY, _mm256_set1_ps(rayDirection.y))),
+					_mm256_mul_ps(reflectionZ, _mm256_set1_ps(rayDirection.z)));
 
-				if (m_CurrentLightingMode == LightingMode::ObservedArea)
-				{
-					finalColor.r += lambert;
-					finalColor.g += lambert;
-					finalColor.b += lambert;
-				}
-				else if (m_CurrentLightingMode == LightingMode::BRDF)
-				{
-					finalColor += lightShading; 
-				}
-				else if (m_CurrentLightingMode == LightingMode::Combined)
+				//No vector pow, the exponent is taken per lane and only where the lobe is visible
+				alignas(32) float specular[LightPool::GroupSize];
+				_mm256_store_ps(specular, dotRV);
+				const uint32_t lobeLanes = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_and_ps(contributing, _mm256_cmp_ps(dotRV, zero, _CMP_GT_OQ))));
+				for (uint32_t lane{ 0 }; lane < LightPool::GroupSize; ++lane)
 				{
-					finalColor += LightUtils::GetRadiance(Light, closestHit.origin) * lightShading * lambert;
+					specular[lane] = (lobeLanes >> lane) & 1 ? material.specularReflectance * std::pow(specular[lane], material.phongExponent) : 0.f;
 				}
-				
+
+				const __m256 phong = _mm256_load_ps(specular);
+				brdfRed = _mm256_add_ps(brdfRed, phong);
+				brdfGreen = _mm256_add_ps(brdfGreen, phong);
+				brdfBlue = _mm256_add_ps(brdfBlue, phong);
 			}
-			if (m_CurrentLightingMode == LightingMode::Radiance)
+			else if (material.type == MaterialType::CookTorrence)
 			{
-				finalColor += LightUtils::GetRadiance(Light, closestHit.origin);
+				//Fresnel and the view half of Smith only depend on the hit, D and the light half of Smith on each light
+				const ColorRGB fresnel = BRDF::FresnelFunction_Schlick(normal, view, material.f0);
+				const float geometryView = BRDF::GeometryFunction_SchlickGGX_K(normal, view, material.schlickK);
+				const float normalDotView = Vector3::Dot(view, normal);
+
+				const __m256 halfX = _mm256_add_ps(_mm256_set1_ps(view.x), lightX);
+				const __m256 halfY = _mm256_add_ps(_mm256_set1_ps(view.y), lightY);
+				const __m256 halfZ = _mm256_add_ps(_mm256_set1_ps(view.z), lightZ);
+				const __m256 halfSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(halfX, halfX), _mm256_mul_ps(halfY, halfY)), _mm256_mul_ps(halfZ, halfZ));
+				const __m256 normalDotHalf = _mm256_div_ps(
+					_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(normalX, halfX), _mm256_mul_ps(normalY, halfY)), _mm256_mul_ps(normalZ, halfZ)),
+					_mm256_sqrt_ps(halfSquared));
+
+				const __m256 alpha2 = _mm256_set1_ps(material.alpha2);
+				const __m256 distributionTerm = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(normalDotHalf, normalDotHalf), _mm256_sub_ps(alpha2, one)), one);
+				const __m256 normalDistribution = _mm256_div_ps(alpha2, _mm256_mul_ps(_mm256_set1_ps(PI), _mm256_mul_ps(distributionTerm, distributionTerm)));
+
+				const __m256 k = _mm256_set1_ps(material.schlickK);
+				const __m256 geometryLight = _mm256_div_ps(lambert, _mm256_add_ps(_mm256_mul_ps(lambert, _mm256_sub_ps(one, k)), k));
+				const __m256 geometry = _mm256_mul_ps(_mm256_set1_ps(geometryView), geometryLight);
+
+				const __m256 specular = _mm256_div_ps(_mm256_mul_ps(geometry, normalDistribution), _mm256_mul_ps(_mm256_set1_ps(4.f), _mm256_mul_ps(_mm256_set1_ps(normalDotView), lambert)));
+				brdfRed = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(fresnel.r), specular), brdfRed);
+				brdfGreen = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(fresnel.g), specular), brdfGreen);
+				brdfBlue = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(fresnel.b), specular), brdfBlue);
 			}
-			
-			
+		}
 
+		red = _mm256_mul_ps(radianceRed, brdfRed);
+		green = _mm256_mul_ps(radianceGreen, brdfGreen);
+		blue = _mm256_mul_ps(radianceBlue, brdfBlue);
+		if constexpr (Mode == LightingMode::Combined)
+		{
+			red = _mm256_mul_ps(red, lambert);
+			green = _mm256_mul_ps(green, lambert);
+			blue = _mm256_mul_ps(blue, lambert);
+		}
+	}
 
-			if (m_ShadowEnabled)
+	//Padding lanes and lights behind the surface may hold anything up to NaN, the mask clears them to zero
+	_mm256_store_ps(shading.red, _mm256_and_ps(red, contributing));
+	_mm256_store_ps(shading.green, _mm256_and_ps(green, contributing));
+	_mm256_store_ps(shading.blue, _mm256_and_ps(blue, contributing));
+	shading.contributing = static_cast<uint32_t>(_mm256_movemask_ps(contributing));
+#else
+	shading.contributing = 0;
+	for (uint32_t lane{ 0 }; lane < LightPool::GroupSize; ++lane)
+	{
+		shading.red[lane] = shading.green[lane] = shading.blue[lane] = 0.f;
+		if (lane >= lanes)
+			continue;
+
+		const uint32_t lightIndex{ first + lane };
+		const float positional{ lightPool.positional[lightIndex] };
+		const Vector3 toLight{
+			lightPool.x[lightIndex] - positional * closestHit.origin.x,
+			lightPool.y[lightIndex] - positional * closestHit.origin.y,
+			lightPool.z[lightIndex] - positional * closestHit.origin.z };
+		const float squaredDistance{ toLight.SqrMagnitude() };
+		const Vector3 lightDirection = toLight / sqrtf(squaredDistance);
+
+		const float lambert = Vector3::Dot(normal, lightDirection);
+		if (Mode != LightingMode::Radiance && !(lambert > 0.0f))
+			continue;
+
+		ColorRGB color{ lambert, lambert, lambert };
+		if constexpr (Mode != LightingMode::ObservedArea)
+		{
+			const float falloff{ positional > 0.f ? squaredDistance : 1.f };
+			const ColorRGB radiance{ lightPool.red[lightIndex] / falloff, lightPool.green[lightIndex] / falloff, lightPool.blue[lightIndex] / falloff };
+
+			if constexpr (Mode == LightingMode::Radiance)
+				color = radiance;
+			else if constexpr (Mode == LightingMode::BRDF)
+				color = material.Shade(closestHit, lightDirection, view);
+			else
+				color = radiance * material.Shade(closestHit, lightDirection, view) * lambert;
+		}
+
+		shading.red[lane] = color.r;
+		shading.green[lane] = color.g;
+		shading.blue[lane] = color.b;
+		shading.contributing |= 1u << lane;
+	}
+#endif
+}
+
+template<bool ShadowsEnabled>
+void Renderer::GatherLightGroup(Scene* pScene, uint32_t group, const LightGroupShading& shading, const HitRecord& closestHit, ColorRGB& finalColor) const
+{
+	const LightPool& lightPool = pScene->GetLightPool();
+
+	for (uint32_t lanes{ shading.contributing }; lanes != 0; lanes &= lanes - 1)
+	{
+		const uint32_t lane = static_cast<uint32_t>(std::countr_zero(lanes));
+		finalColor += ColorRGB{ shading.red[lane], shading.green[lane], shading.blue[lane] };
+
+		if constexpr (ShadowsEnabled)
+		{
+			//Point light shadow rays all end at the light, its invariants shorten their sphere and plane tests
+			const uint32_t lightIndex{ group * LightPool::GroupSize + lane };
+			const PointInvariants* pInvariants = lightPool.positional[lightIndex] > 0.f ? &m_LightInvariants[lightIndex] : nullptr;
+
+			if (pScene->DoesHit(GetShadowRay(lightPool, lightIndex, closestHit), pInvariants))
+			{
+				finalColor *= 0.95f;
+			}
+		}
+	}
+}
+
+void Renderer::WritePixel(uint32_t pixelIndex, const ColorRGB& finalColor) const
+{
+	m_FrameRed[pixelIndex] = finalColor.r;
+	m_FrameGreen[pixelIndex] = finalColor.g;
+	m_FrameBlue[pixelIndex] = finalColor.b;
+}
+
+void Renderer::Resolve(uint32_t* pPixels)
+{
+	if (m_Width == m_WindowWidth && m_Height == m_WindowHeight)
+	{
+		ForEachChunk(GetPixelCount(), ResolveChunk, [&](uint32_t first, uint32_t last)
+			{
+				ResolvePixels(&m_FrameRed[first], &m_FrameGreen[first], &m_FrameBlue[first], &pPixels[first], last - first);
+			});
+		return;
+	}
+
+	const uint32_t amountOfChunks{ (uint32_t(m_WindowHeight) + UpscaleRowChunk - 1) / UpscaleRowChunk };
+	m_pThreadPool->Run(amountOfChunks, [&](uint32_t chunk, uint32_t worker)
+		{
+			for (uint32_t row{ chunk * UpscaleRowChunk }; row < std::min(uint32_t(m_WindowHeight), (chunk + 1) * UpscaleRowChunk); ++row)
+			{
+				UpscaleRow(pPixels, row, m_UpscaleRows[worker]);
+			}
+		});
+}
+
+void Renderer::UpscaleRow(uint32_t* pPixels, uint32_t row, std::vector<float>& upscaledRow) const
+{
+	const uint32_t width{ uint32_t(m_WindowWidth) };
+	float* pRed = upscaledRow.data();
+	float* pGreen = pRed + width;
+	float* pBlue = pGreen + width;
+
+	const float frameRow{ std::clamp((row + 0.5f) * m_Height / static_cast<float>(m_WindowHeight) - 0.5f, 0.f, static_cast<float>(m_Height - 1)) };
+	const uint32_t top{ std::min(static_cast<uint32_t>(frameRow), static_cast<uint32_t>(m_Height - 2)) };
+	const float weightY{ frameRow - static_cast<float>(top) };
+	const uint32_t topOffset{ top * uint32_t(m_Width) }, bottomOffset{ topOffset + uint32_t(m_Width) };
+
+	uint32_t x{ 0 };
+
+#if defined(__AVX2__)
+	//Four gathers per channel, the left and right neighbour in the row above and below
+	const __m256 verticalWeight = _mm256_set1_ps(weightY);
+	const auto sampleChannels = [&](const std::vector<float>& channel, __m256i left, __m256 horizontalWeight)
+		{
+			const float* pTop = channel.data() + topOffset;
+			const float* pBottom = channel.data() + bottomOffset;
+			const __m256 topLeft = _mm256_i32gather_ps(pTop, left, 4);
+			const __m256 topRight = _mm256_i32gather_ps(pTop + 1, left, 4);
+			const __m256 bottomLeft = _mm256_i32gather_ps(pBottom, left, 4);
+			const __m256 bottomRight = _mm256_i32gather_ps(pBottom + 1, left, 4);
+
+			const __m256 upper = _mm256_add_ps(topLeft, _mm256_mul_ps(_mm256_sub_ps(topRight, topLeft), horizontalWeight));
+			const __m256 lower = _mm256_add_ps(bottomLeft, _mm256_mul_ps(_mm256_sub_ps(bottomRight, bottomLeft), horizontalWeight));
+			return _mm256_add_ps(upper, _mm256_mul_ps(_mm256_sub_ps(lower, upper), verticalWeight));
+		};
+
+	for (; x + 8 <= width; x += 8)
+	{
+		const __m256i left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&m_UpscaleColumns[x]));
+		const __m256 horizontalWeight = _mm256_loadu_ps(&m_UpscaleWeights[x]);
+
+		_mm256_storeu_ps(&pRed[x], sampleChannels(m_FrameRed, left, horizontalWeight));
+		_mm256_storeu_ps(&pGreen[x], sampleChannels(m_FrameGreen, left, horizontalWeight));
+		_mm256_storeu_ps(&pBlue[x], sampleChannels(m_FrameBlue, left, horizontalWeight));
+	}
+#endif
+
+	const auto sampleChannel = [&](const std::vector<float>& channel, uint32_t left, float horizontalWeight)
+		{
+			const float upper{ channel[topOffset + left] + (channel[topOffset + left + 1] - channel[topOffset + left]) * horizontalWeight };
+			const float lower{ channel[bottomOffset + left] + (channel[bottomOffset + left + 1] - channel[bottomOffset + left]) * horizontalWeight };
+			return upper + (lower - upper) * weightY;
+		};
+
+	for (; x < width; ++x)
+	{
+		pRed[x] = sampleChannel(m_FrameRed, m_UpscaleColumns[x], m_UpscaleWeights[x]);
+		pGreen[x] = sampleChannel(m_FrameGreen, m_UpscaleColumns[x], m_UpscaleWeights[x]);
+		pBlue[x] = sampleChannel(m_FrameBlue, m_UpscaleColumns[x], m_UpscaleWeights[x]);
+	}
+
+	ResolvePixels(pRed, pGreen, pBlue, &pPixels[row * width], width);
+}
+
+void Renderer::ResolvePixels(const float* pRed, const float* pGreen, const float* pBlue, uint32_t* pPixels, uint32_t count) const
+{
+	uint32_t pixelIndex{ 0 };
+
+#if defined(__AVX2__)
+	if (m_PackWithShifts)
+	{
+		const __m256 exposure = _mm256_set1_ps(m_Exposure);
+		const __m256 one = _mm256_set1_ps(1.f);
+		const __m256 maxChannel = _mm256_set1_ps(255.f);
+		const __m128i redShift = _mm_cvtsi32_si128(static_cast<int>(m_RedShift));
+		const __m128i greenShift = _mm_cvtsi32_si128(static_cast<int>(m_GreenShift));
+		const __m128i blueShift = _mm_cvtsi32_si128(static_cast<int>(m_BlueShift));
+		const __m256i alpha = _mm256_set1_epi32(static_cast<int>(m_AlphaMask));
+
+		for (; pixelIndex + 8 <= count; pixelIndex += 8)
+		{
+			__m256 red = _mm256_mul_ps(_mm256_loadu_ps(&pRed[pixelIndex]), exposure);
+			__m256 green = _mm256_mul_ps(_mm256_loadu_ps(&pGreen[pixelIndex]), exposure);
+			__m256 blue = _mm256_mul_ps(_mm256_loadu_ps(&pBlue[pixelIndex]), exposure);
+
+			//ColorRGB::MaxToOne, dividing the channels that stay below one by one changes nothing
+			const __m256 maxValue = _mm256_max_ps(red, _mm256_max_ps(green, blue));
+			const __m256 divisor = _mm256_blendv_ps(one, maxValue, _mm256_cmp_ps(maxValue, one, _CMP_GT_OQ));
+			red = _mm256_div_ps(red, divisor);
+			green = _mm256_div_ps(green, divisor);
+			blue = _mm256_div_ps(blue, divisor);
+
+			const __m256i redBits = _mm256_cvttps_epi32(_mm256_max_ps(_mm256_mul_ps(red, maxChannel), _mm256_setzero_ps()));
+			const __m256i greenBits = _mm256_cvttps_epi32(_mm256_max_ps(_mm256_mul_ps(green, maxChannel), _mm256_setzero_ps()));
+			const __m256i blueBits = _mm256_cvttps_epi32(_mm256_max_ps(_mm256_mul_ps(blue, maxChannel), _mm256_setzero_ps()));
+
+			__m256i pixels = _mm256_or_si256(_mm256_sll_epi32(redBits, redShift), _mm256_sll_epi32(greenBits, greenShift));
+			pixels = _mm256_or_si256(pixels, _mm256_or_si256(_mm256_sll_epi32(blueBits, blueShift), alpha));
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(&pPixels[pixelIndex]), pixels);
+		}
+	}
+#endif
+
+	for (; pixelIndex < count; ++pixelIndex)
+	{
+		ColorRGB finalColor{ pRed[pixelIndex], pGreen[pixelIndex], pBlue[pixelIndex] };
+		finalColor *= m_Exposure;
+		finalColor.MaxToOne();
+
+		pPixels[pixelIndex] = SDL_MapRGB(m_pBuffer->format,
+			static_cast<uint8_t>(finalColor.r * 255),
+			static_cast<uint8_t>(finalColor.g * 255),
+			static_cast<uint8_t>(finalColor.b * 255));
+	}
+}
+
+#pragma region Wavefront
+template<typename Function>
+void Renderer::ForEachChunk(uint32_t count, uint32_t chunkSize, Function&& function)
+{
+	const uint32_t amountOfChunks{ (count + chunkSize - 1) / chunkSize };
+	m_pThreadPool->Run(amountOfChunks, [&](uint32_t chunk, uint32_t) { function(chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize)); });
+}
+template<Renderer::LightingMode Mode, bool ShadowsEnabled>
+void Renderer::RenderWavefront(Scene* pScene)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	const auto elapsedMilliseconds = [](Clock::time_point& start)
+		{
+			const Clock::time_point now = Clock::now();
+			const float milliseconds = std::chrono::duration<float, std::milli>(now - start).count();
+			start = now;
+			return milliseconds;
+		};
+
+	Clock::time_point stageStart = Clock::now();
+
+	Camera& camera = pScene->GetCamera();
+	const auto& materials = pScene->GetMaterials();
+	const LightPool& lightPool = pScene->GetLightPool();
+
+	const float aspectRatio = static_cast<float>(m_Width) / static_cast<float>(m_Height);
+	const float fov = tanf(camera.fovAngle * TO_RADIANS / 2);
+	const Matrix cameraToWorld = camera.CalculateCameraToWorld();
+
+	const uint32_t amountOfPixels{ uint32_t(m_Width * m_Height) };
+	const uint32_t packetsPerRow{ (uint32_t(m_Width) + RayPacket::Width - 1) / RayPacket::Width };
+	const uint32_t amountOfPackets{ packetsPerRow * ((uint32_t(m_Height) + RayPacket::Height - 1) / RayPacket::Height) };
+
+	m_Packets.resize(amountOfPackets);
+	m_ClosestHits.resize(amountOfPixels);
+	m_RayDirections.resize(amountOfPixels);
+	m_PixelColors.assign(amountOfPixels, ColorRGB{ 0,0,0 });
+
+	const auto packetPixel = [&](uint32_t packetIndex, uint32_t lane)
+		{
+			const uint32_t px{ (packetIndex % packetsPerRow) * RayPacket::Width + lane % RayPacket::Width };
+			const uint32_t py{ (packetIndex / packetsPerRow) * RayPacket::Height + lane / RayPacket::Width };
+			return px + py * uint32_t(m_Width);
+		};
+
+	//Generate: every primary ray of the frame, one packet per block
+	ForEachChunk(amountOfPackets, WavefrontPacketChunk, [&](uint32_t first, uint32_t last)
+		{
+			for (uint32_t packetIndex = first; packetIndex < last; ++packetIndex)
+			{
+				RayPacket& packet = m_Packets[packetIndex];
+				packet = RayPacket{};
+				packet.origin = camera.origin;
+
+				const uint32_t firstX{ (packetIndex % packetsPerRow) * RayPacket::Width };
+				const uint32_t firstY{ (packetIndex / packetsPerRow) * RayPacket::Height };
+
+				for (uint32_t lane{ 0 }; lane < RayPacket::Size; ++lane)
+				{
+					const uint32_t px{ firstX + lane % RayPacket::Width }, py{ firstY + lane / RayPacket::Width };
+					if (px < uint32_t(m_Width) && py < uint32_t(m_Height))
+						packet.SetRay(lane, GetPrimaryRayDirection(px, py, fov, aspectRatio, cameraToWorld));
+				}
+
+				packet.Prepare();
+			}
+		});
+	m_WavefrontTimings.generate = elapsedMilliseconds(stageStart);
+
+	//Intersect: closest hits of all packets, scattered back to pixel order
+	ForEachChunk(amountOfPackets, WavefrontPacketChunk, [&](uint32_t first, uint32_t last)
+		{
+			HitRecord closestHits[RayPacket::Size];
+
+			for (uint32_t packetIndex = first; packetIndex < last; ++packetIndex)
 			{
-				
-				if (pScene->DoesHit(lightRay))
+				RayPacket& packet = m_Packets[packetIndex];
+
+				std::fill(std::begin(closestHits), std::end(closestHits), HitRecord{});
+				pScene->GetClosestHits(packet, closestHits, &m_CameraInvariants);
+
+				for (uint32_t lanes{ packet.mask }; lanes != 0; lanes &= lanes - 1)
 				{
-					finalColor *= 0.95f;
+					const uint32_t lane = static_cast<uint32_t>(std::countr_zero(lanes));
+					const uint32_t pixelIndex{ packetPixel(packetIndex, lane) };
+
+					m_ClosestHits[pixelIndex] = closestHits[lane];
+					m_RayDirections[pixelIndex] = { packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane] };
 				}
+			}
+		});
+	m_WavefrontTimings.intersect = elapsedMilliseconds(stageStart);
+
+	//Compact and sort: counting sort of the hit pixels by material, so every material is shaded as one contiguous run.
+	//Every worker counts and scatters one contiguous pixel range, so the queue keeps the pixel order within a material
+	const uint32_t materialCount{ static_cast<uint32_t>(materials.size()) };
+	const uint32_t rangeCount{ m_pThreadPool->GetThreadCount() };
+	const uint32_t rangeSize{ (amountOfPixels + rangeCount - 1) / rangeCount };
+	m_InsertOffsets.assign(size_t(rangeCount) * materialCount, 0);
 
+	m_pThreadPool->Run(rangeCount, [&](uint32_t range, uint32_t)
+		{
+			uint32_t* counts{ &m_InsertOffsets[size_t(range) * materialCount] };
+			const uint32_t last{ std::min(amountOfPixels, (range + 1) * rangeSize) };
+			for (uint32_t pixelIndex{ range * rangeSize }; pixelIndex < last; ++pixelIndex)
+			{
+				if (m_ClosestHits[pixelIndex].didHit)
+					++counts[m_ClosestHits[pixelIndex].materialIndex];
 			}
-			
+		});
 
+	//Material by material, a range starts after the hits of the ranges before it
+	m_MaterialOffsets.resize(size_t(materialCount) + 1);
+	uint32_t hitCount{ 0 };
+	for (uint32_t material{ 0 }; material < materialCount; ++material)
+	{
+		m_MaterialOffsets[material] = hitCount;
+		for (uint32_t range{ 0 }; range < rangeCount; ++range)
+		{
+			uint32_t& insertOffset{ m_InsertOffsets[size_t(range) * materialCount + material] };
+			const uint32_t count{ insertOffset };
+			insertOffset = hitCount;
+			hitCount += count;
 		}
 	}
+	m_MaterialOffsets[materialCount] = hitCount;
 
-	finalColor.MaxToOne();
+	m_HitQueue.resize(hitCount);
+	m_pThreadPool->Run(rangeCount, [&](uint32_t range, uint32_t)
+		{
+			uint32_t* insertOffsets{ &m_InsertOffsets[size_t(range) * materialCount] };
+			const uint32_t last{ std::min(amountOfPixels, (range + 1) * rangeSize) };
+			for (uint32_t pixelIndex{ range * rangeSize }; pixelIndex < last; ++pixelIndex)
+			{
+				if (m_ClosestHits[pixelIndex].didHit)
+					m_HitQueue[insertOffsets[m_ClosestHits[pixelIndex].materialIndex]++] = pixelIndex;
+			}
+		});
+	m_LightShading.resize(m_HitQueue.size());
+	m_WavefrontTimings.sort = elapsedMilliseconds(stageStart);
+
+	m_WavefrontTimings.shade = 0.f;
+	m_WavefrontTimings.shadow = 0.f;
+
+	//Light groups one after the other, within a group the lights are gathered in order exactly like ShadePixel does
+	for (uint32_t group{ 0 }; group < lightPool.GroupCount(); ++group)
+	{
+		//Shade: one material at a time, every light of the group per hit
+		for (size_t materialIndex{ 0 }; materialIndex < materials.size(); ++materialIndex)
+		{
+			const Material& material = materials[materialIndex];
+			const uint32_t materialFirst{ m_MaterialOffsets[materialIndex] };
+
+			ForEachChunk(m_MaterialOffsets[materialIndex + 1] - materialFirst, WavefrontRayChunk, [&](uint32_t first, uint32_t last)
+				{
+					for (uint32_t i = materialFirst + first; i < materialFirst + last; ++i)
+					{
+						const uint32_t pixelIndex{ m_HitQueue[i] };
+						ShadeLightGroup<Mode>(lightPool, group, material, m_ClosestHits[pixelIndex], m_RayDirections[pixelIndex], m_LightShading[i]);
+					}
+				});
+		}
+		m_WavefrontTimings.shade += elapsedMilliseconds(stageStart);
 
-	m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-		static_cast<uint8_t>(finalColor.r * 255),
-		static_cast<uint8_t>(finalColor.g * 255),
-		static_cast<uint8_t>(finalColor.b * 255));
+		//Shadow: the occlusion queries of the contributing lights of the group, gathered into the pixels
+		ForEachChunk(static_cast<uint32_t>(m_HitQueue.size()), WavefrontRayChunk, [&](uint32_t first, uint32_t last)
+			{
+				for (uint32_t i = first; i < last; ++i)
+				{
+					const uint32_t pixelIndex{ m_HitQueue[i] };
+					GatherLightGroup<ShadowsEnabled>(pScene, group, m_LightShading[i], m_ClosestHits[pixelIndex], m_PixelColors[pixelIndex]);
+				}
+			});
+		m_WavefrontTimings.shadow += elapsedMilliseconds(stageStart);
+	}
+
+	ForEachChunk(amountOfPixels, WavefrontRayChunk, [&](uint32_t first, uint32_t last)
+		{
+			for (uint32_t pixelIndex = first; pixelIndex < last; ++pixelIndex)
+			{
+				WritePixel(pixelIndex, m_PixelColors[pixelIndex]);
+			}
+		});
+	m_WavefrontTimings.write = elapsedMilliseconds(stageStart);
 }
 
+#pragma endregion
+
 
 bool Renderer::SaveBufferToImage() const
 {
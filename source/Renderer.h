@@ -1,9 +1,14 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
+#include "DataTypes.h"
 #include "Matrix.h"
+#include "ThreadPool.h"
 
 #include <iostream>
+#include <memory>
+#include <vector>
 
 struct SDL_Window;
 struct SDL_Surface;
@@ -11,21 +16,53 @@ struct SDL_Surface;
 namespace dae
 {
 	class Scene;
+	struct Material;
 
 	class Renderer final
 	{
 	public:
-		Renderer(SDL_Window* pWindow);
-		~Renderer() = default;
+		enum class LightingMode
+		{
+			ObservedArea,
+			Radiance,
+			BRDF,
+			Combined
+		};
+
+		//threads configures the render pool, see ConfigureThreads
+		Renderer(SDL_Window* pWindow, const ThreadPool::Configuration& threads = {});
+		~Renderer();
 
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
-		void Render(Scene* pScene) const;
-		void RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Matrix cameraToWorld, const Vector3 cameraOrigin) const;
+		void Render(Scene* pScene);
+		//Render in stages for FramePipeline. Trace fills the linear frame, Resolve packs it into pPixels,
+		//GetPixelCount() values in the window surface format, and Present copies pPixels into the window surface.
+		//UpdateWindow puts the window surface on screen, SDL only allows that on the thread that created the window
+		void Trace(Scene* pScene);
+		void Resolve(uint32_t* pPixels);
+		void Present(const uint32_t* pPixels);
+		void UpdateWindow();
+		uint32_t GetPixelCount() const { return uint32_t(m_WindowWidth) * uint32_t(m_WindowHeight); }
 
+		//Dynamic resolution: frames are traced at a fraction of the window size and upscaled bilinearly by Resolve.
+		//Every Trace moves that fraction toward the target FPS, from the frame times handed to ReportFrameTime
+		void ToggleDynamicResolution()
+		{
+			m_DynamicResolutionEnabled = !m_DynamicResolutionEnabled;
+			std::cout << " \nDYNAMIC RESOLUTION: " << (m_DynamicResolutionEnabled ? "ON" : "OFF") << std::endl;
+		}
+		bool IsDynamicResolutionEnabled() const { return m_DynamicResolutionEnabled; }
+		void SetTargetFPS(float targetFPS) { m_TargetFPS = targetFPS; }
+		float GetTargetFPS() const { return m_TargetFPS; }
+		//Seconds the last frame took, Timer::GetElapsed. Safe to call while another thread traces
+		void ReportFrameTime(float seconds) { m_ReportedFrameTime.store(seconds, std::memory_order_relaxed); }
+		float GetRenderScale() const { return m_RenderScale; }
+		int GetRenderWidth() const { return m_Width; }
+		int GetRenderHeight() const { return m_Height; }
 
 		bool SaveBufferToImage() const;
 
@@ -51,6 +88,73 @@ namespace dae
 			}
 		};
 		void ToggleShadows() { m_ShadowEnabled = !m_ShadowEnabled; }
+		void ToggleWavefront()
+		{
+			m_WavefrontEnabled = !m_WavefrontEnabled;
+			std::cout << " \nRENDER PATH: " << (m_WavefrontEnabled ? "WAVEFRONT" : "PER PIXEL") << std::endl;
+		}
+		bool IsWavefrontEnabled() const { return m_WavefrontEnabled; }
+
+		//Milliseconds spent in every stage of the last wavefront frame, shade and shadow summed over the lights
+		struct WavefrontTimings
+		{
+			float generate{};
+			float intersect{};
+			float sort{};
+			float shade{};
+			float shadow{};
+			float write{};
+		};
+		const WavefrontTimings& GetWavefrontTimings() const { return m_WavefrontTimings; }
+
+		//Progressive mode: a frame first traces 1 in 16 pixels and fills the 4x4 blocks around them, then refines in further passes
+		//while its budget lasts. As long as the camera, the scene and the settings stay the same the next frames keep refining the image
+		void ToggleProgressive()
+		{
+			m_ProgressiveEnabled = !m_ProgressiveEnabled;
+			m_ProgressivePass = 0;
+			std::cout << " \nPROGRESSIVE: " << (m_ProgressiveEnabled ? "ON" : "OFF") << std::endl;
+		}
+		bool IsProgressiveEnabled() const { return m_ProgressiveEnabled; }
+		//Milliseconds of tracing per progressive frame, the first pass of a new image is traced even if it takes longer
+		void SetFrameBudget(float milliseconds) { m_FrameBudget = milliseconds; }
+		float GetFrameBudget() const { return m_FrameBudget; }
+
+		static constexpr uint32_t ProgressivePasses{ 16 };
+		struct ProgressiveStatistics
+		{
+			uint32_t passes{}; //traced during the last frame
+			uint32_t refined{}; //passes of the current image so far, ProgressivePasses once it is complete
+			float passTime{}; //ms of the last pass, the estimate for the next one
+		};
+		const ProgressiveStatistics& GetProgressiveStatistics() const { return m_ProgressiveStatistics; }
+
+		//Square tiles the per pixel path hands to the workers, rounded up to a multiple of the packet size
+		void SetTileSize(uint32_t tileSize);
+		uint32_t GetTileSize() const { return m_TileSize; }
+
+		//Scheduling of the tiles of the last per pixel frame: wall time, the part of it the workers were not tracing and
+		//how far the busiest worker was above the average
+		struct TileStatistics
+		{
+			float wall{};
+			float overhead{};
+			float imbalance{};
+			uint32_t tiles{};
+			uint32_t steals{};
+			uint32_t threads{};
+		};
+		const TileStatistics& GetTileStatistics() const { return m_TileStatistics; }
+
+		//Rebuilds the render pool between frames, without PARRALEL_EXECUTION it always has a single worker
+		void ConfigureThreads(const ThreadPool::Configuration& configuration);
+		uint32_t GetThreadCount() const;
+		//Logical processor per worker, empty unless the pool is pinned
+		const std::vector<uint32_t>& GetThreadProcessors() const;
+
+		//Scales the linear frame before it is clamped and packed, 1 leaves it as rendered
+		void SetExposure(float exposure) { m_Exposure = exposure; }
+		float GetExposure() const { return m_Exposure; }
 
 	private:
 		SDL_Window* m_pWindow{};
@@ -58,19 +162,164 @@ namespace dae
 		SDL_Surface* m_pBuffer{};
 		uint32_t* m_pBufferPixels{};
 
+		int m_WindowWidth{};
+		int m_WindowHeight{};
+		//Render resolution, the window size unless dynamic resolution scaled it down
 		int m_Width{};
 		int m_Height{};
 
-		enum class LightingMode
-		{
-			ObservedArea,
-			Radiance,
-			BRDF,
-			Combined
-		};
+		bool m_DynamicResolutionEnabled{ false };
+		float m_TargetFPS{ 30.f };
+		float m_RenderScale{ 1.f };
+		float m_AverageFrameTime{}; //seconds, 0 until a frame at the current resolution was reported
+		std::atomic<float> m_ReportedFrameTime{}; //0 once the next Trace took it
+		static constexpr float MinRenderScale{ 0.25f };
+		static constexpr uint32_t UpscaleRowChunk{ 8 };
+		std::vector<uint32_t> m_UpscaleColumns{}; //per window column: left render column of its bilinear footprint
+		std::vector<float> m_UpscaleWeights{}; //per window column: weight of the right render column
+		std::vector<std::vector<float>> m_UpscaleRows{}; //per worker: one upscaled window row, red, green and blue after each other
+		void UpdateRenderScale();
+		void ResizeFrame(int width, int height);
 
 		LightingMode m_CurrentLightingMode{ LightingMode::Combined };
 		bool m_ShadowEnabled{true};
 
+		//Linear float frame, SoA. The render paths only write these, Resolve applies the exposure,
+		//clamps like ColorRGB::MaxToOne and packs the whole frame into the surface or a FramePipeline buffer once
+		mutable std::vector<float> m_FrameRed{};
+		mutable std::vector<float> m_FrameGreen{};
+		mutable std::vector<float> m_FrameBlue{};
+		float m_Exposure{ 1.f };
+
+		static constexpr uint32_t ResolveChunk{ 4096 };
+
+		//Surface layout, read once from its SDL_PixelFormat
+		bool m_PackWithShifts{};
+		uint32_t m_RedShift{};
+		uint32_t m_GreenShift{};
+		uint32_t m_BlueShift{};
+		uint32_t m_AlphaMask{};
+
+		//Shading of one hit by the lights of a LightPool group. Lanes that add nothing are zero and cast no shadow ray
+		struct LightGroupShading
+		{
+			alignas(32) float red[LightPool::GroupSize];
+			alignas(32) float green[LightPool::GroupSize];
+			alignas(32) float blue[LightPool::GroupSize];
+			uint32_t contributing{};
+		};
+
+		//Sphere and plane terms that only depend on the camera or on a light position, refreshed at the start of every Render.
+		//m_LightInvariants is parallel to the LightPool, directional lights have no point and leave their entry unused
+		PointInvariants m_CameraInvariants{};
+		std::vector<PointInvariants> m_LightInvariants{};
+		void UpdateInvariants(Scene* pScene);
+
+		//Per pixel mode: the frame is cut into m_TileSize squares, visited in Morton order so the tiles of one worker stay close together.
+		//Every worker traces into its own TileBuffer and copies it into the frame once the tile is done
+		struct TileBuffer
+		{
+			std::vector<float> red{};
+			std::vector<float> green{};
+			std::vector<float> blue{};
+			uint32_t firstX{};
+			uint32_t firstY{};
+			uint32_t size{};
+
+			void Write(uint32_t px, uint32_t py, const ColorRGB& color)
+			{
+				const uint32_t index{ (px - firstX) + (py - firstY) * size };
+				red[index] = color.r;
+				green[index] = color.g;
+				blue[index] = color.b;
+			}
+		};
+
+		std::unique_ptr<ThreadPool> m_pThreadPool{};
+		uint32_t m_TileSize{ 16 };
+		std::vector<uint32_t> m_TileOrder{}; //tile x | tile y << 16
+		std::vector<TileBuffer> m_TileBuffers{}; //one per worker
+		TileStatistics m_TileStatistics{};
+		void UpdateTiles();
+
+		//Progressive passes trace one pixel of every 4x4 block and fill a size x size square from it,
+		//1 block-wide sample, then 3 that fill a quadrant each and finally the 12 remaining pixels on their own
+		struct ProgressiveSample
+		{
+			uint32_t x{};
+			uint32_t y{};
+			uint32_t size{};
+		};
+		static constexpr uint32_t ProgressiveBlock{ 4 };
+		static constexpr ProgressiveSample ProgressiveSamples[ProgressivePasses]{
+			{ 0, 0, 4 },
+			{ 2, 2, 2 }, { 2, 0, 2 }, { 0, 2, 2 },
+			{ 1, 1, 1 }, { 3, 3, 1 }, { 3, 1, 1 }, { 1, 3, 1 }, { 1, 0, 1 }, { 3, 2, 1 },
+			{ 3, 0, 1 }, { 1, 2, 1 }, { 0, 1, 1 }, { 2, 3, 1 }, { 2, 1, 1 }, { 0, 3, 1 } };
+
+		bool m_ProgressiveEnabled{ false };
+		float m_FrameBudget{ 33.f };
+		uint32_t m_ProgressivePass{}; //next pass of the current image
+		uint64_t m_ProgressiveKey{}; //camera, scene and settings the current image belongs to
+		ProgressiveStatistics m_ProgressiveStatistics{};
+
+		//Wavefront mode: every stage runs over the whole frame before the next one starts.
+		//The buffers keep their capacity from frame to frame
+		bool m_WavefrontEnabled{ false };
+		WavefrontTimings m_WavefrontTimings{};
+
+		static constexpr uint32_t WavefrontPacketChunk{ 64 };
+		static constexpr uint32_t WavefrontRayChunk{ 1024 };
+
+		std::vector<RayPacket> m_Packets{};
+		std::vector<HitRecord> m_ClosestHits{}; //per pixel
+		std::vector<Vector3> m_RayDirections{}; //per pixel
+		std::vector<ColorRGB> m_PixelColors{}; //per pixel
+		std::vector<uint32_t> m_HitQueue{}; //pixels with a hit, sorted by material
+		std::vector<uint32_t> m_MaterialOffsets{}; //first m_HitQueue entry per material, one extra entry holds the end
+		std::vector<uint32_t> m_InsertOffsets{}; //per worker pixel range and material: hit count, then the next m_HitQueue entry of the scatter
+		std::vector<LightGroupShading> m_LightShading{}; //parallel to m_HitQueue, reused for every light group
+
+		//The per pixel kernels are compiled once per lighting mode and shadow setting, Render picks one pair per frame
+		template<LightingMode Mode, bool ShadowsEnabled>
+		void RenderTile(Scene* pScene, uint32_t tileIndex, TileBuffer& tile, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin) const;
+		template<LightingMode Mode, bool ShadowsEnabled>
+		void RenderPixel(Scene* pScene, uint32_t px, uint32_t py, TileBuffer& tile, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin) const;
+		//Traces the RayPacket::Width x RayPacket::Height block at firstX, firstY as one packet, then shades its pixels one by one
+		template<LightingMode Mode, bool ShadowsEnabled>
+		void RenderPacket(Scene* pScene, uint32_t firstX, uint32_t firstY, TileBuffer& tile, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin) const;
+
+		Vector3 GetPrimaryRayDirection(uint32_t px, uint32_t py, float fov, float aspectRatio, const Matrix& cameraToWorld) const;
+		template<LightingMode Mode, bool ShadowsEnabled>
+		ColorRGB ShadePixel(Scene* pScene, const Vector3& rayDirection, const HitRecord& closestHit) const;
+		Ray GetShadowRay(const LightPool& lightPool, uint32_t lightIndex, const HitRecord& closestHit) const;
+		//What every light of a LightPool group adds to a hit before its shadow test, 8 lights per AVX register
+		template<LightingMode Mode>
+		void ShadeLightGroup(const LightPool& lightPool, uint32_t group, const Material& material, const HitRecord& closestHit, const Vector3& rayDirection, LightGroupShading& shading) const;
+		//Adds the lights of a group in order, a shadow scales everything gathered so far
+		template<bool ShadowsEnabled>
+		void GatherLightGroup(Scene* pScene, uint32_t group, const LightGroupShading& shading, const HitRecord& closestHit, ColorRGB& finalColor) const;
+		void WritePixel(uint32_t pixelIndex, const ColorRGB& finalColor) const;
+		//Packs count pixels of linear SoA color into pPixels
+		void ResolvePixels(const float* pRed, const float* pGreen, const float* pBlue, uint32_t* pPixels, uint32_t count) const;
+		//Bilinear upscale of the frame to one window row, then ResolvePixels
+		void UpscaleRow(uint32_t* pPixels, uint32_t row, std::vector<float>& upscaledRow) const;
+
+		//Calls function.template operator()<Mode, ShadowsEnabled>() with the current settings as template arguments
+		template<typename Function>
+		void DispatchKernel(Function&& function) const;
+		template<LightingMode Mode, bool ShadowsEnabled>
+		void RenderFrame(Scene* pScene);
+		template<LightingMode Mode, bool ShadowsEnabled>
+		void RenderProgressive(Scene* pScene);
+		//One progressive pass over a tile, the samples of 16 blocks are traced as one packet
+		template<LightingMode Mode, bool ShadowsEnabled>
+		void RenderProgressiveTile(Scene* pScene, uint32_t tileIndex, const ProgressiveSample& sample, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin) const;
+		template<LightingMode Mode, bool ShadowsEnabled>
+		void RenderWavefront(Scene* pScene);
+		//Runs function(first, last) over [0, count) in chunks of chunkSize on the worker pool
+		template<typename Function>
+		void ForEachChunk(uint32_t count, uint32_t chunkSize, Function&& function);
+
 	};
 }
@@ -7,7 +7,7 @@ namespace dae {
 #pragma region Base Scene
 	//Initialize Scene with Default Solid Color Material (RED)
 	Scene::Scene():
-		m_Materials({ new Material_SolidColor({1,0,0})})
+		m_Materials({ Material::SolidColor({1,0,0}) })
 	{
 		m_SphereGeometries.reserve(32);
 		m_PlaneGeometries.reserve(32);
@@ -15,61 +15,254 @@ namespace dae {
 		m_Lights.reserve(32);
 	}
 
-	Scene::~Scene()
+	Scene::~Scene() = default;
+
+	void Scene::UpdateTopLevelBVH()
 	{
-		for(auto& pMaterial : m_Materials)
+		UpdateSpherePool();
+		UpdateLightPool();
+
+		const size_t primitiveCount{ m_SpherePool.GroupCount() + m_Triangles.size() + m_TriangleMeshGeometries.size() };
+
+		m_Primitives.clear();
+		m_Primitives.reserve(primitiveCount);
+
+		std::vector<AABB> primitiveBounds{};
+		primitiveBounds.reserve(primitiveCount);
+
+		for (uint32_t group = 0; group < m_SpherePool.GroupCount(); ++group)
 		{
-			delete pMaterial;
-			pMaterial = nullptr;
+			AABB bounds{};
+			for (uint32_t i = group * SpherePool::GroupSize; i < group * SpherePool::GroupSize + m_SpherePool.GroupLanes(group); ++i)
+			{
+				const float radius = sqrtf(m_SpherePool.radiusSquared[i]);
+				const Vector3 center{ m_SpherePool.x[i], m_SpherePool.y[i], m_SpherePool.z[i] };
+				bounds.Grow(center - Vector3{ radius, radius, radius });
+				bounds.Grow(center + Vector3{ radius, radius, radius });
+			}
+
+			m_Primitives.emplace_back(PrimitiveReference{ PrimitiveType::SphereGroup, group });
+			primitiveBounds.emplace_back(bounds);
 		}
 
-		m_Materials.clear();
+		for (uint32_t i = 0; i < m_Triangles.size(); ++i)
+		{
+			const Triangle& triangle = m_Triangles[i];
+			AABB bounds{};
+			bounds.Grow(triangle.v0);
+			bounds.Grow(triangle.v1);
+			bounds.Grow(triangle.v2);
+
+			m_Primitives.emplace_back(PrimitiveReference{ PrimitiveType::Triangle, i });
+			primitiveBounds.emplace_back(bounds);
+		}
+
+		for (uint32_t i = 0; i < m_TriangleMeshGeometries.size(); ++i)
+		{
+			const TriangleMesh& mesh = m_TriangleMeshGeometries[i];
+
+			m_Primitives.emplace_back(PrimitiveReference{ PrimitiveType::TriangleMesh, i });
+			primitiveBounds.emplace_back(AABB{ mesh.transformedMinAABB, mesh.transformedMaxAABB });
+		}
+
+		m_TopLevelBVH.Build(primitiveBounds, m_TopLevelBuildQuality);
+
+		UpdateContentHash();
 	}
 
-	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
+	void Scene::UpdateSpherePool()
 	{
-		
+		AABB centerBounds{};
 		for (const Sphere& sphere : m_SphereGeometries)
 		{
-			GeometryUtils::HitTest_Sphere(sphere, ray, closestHit);
+			centerBounds.Grow(sphere.origin);
+		}
+
+		std::vector<std::pair<uint32_t, uint32_t>> mortonOrder(m_SphereGeometries.size());
+		for (uint32_t i = 0; i < m_SphereGeometries.size(); ++i)
+		{
+			mortonOrder[i] = { BVH::MortonCode(m_SphereGeometries[i].origin, centerBounds), i };
+		}
+		std::sort(mortonOrder.begin(), mortonOrder.end());
+
+		m_SpherePool.Resize(static_cast<uint32_t>(m_SphereGeometries.size()));
+		for (uint32_t i = 0; i < mortonOrder.size(); ++i)
+		{
+			m_SpherePool.Set(i, m_SphereGeometries[mortonOrder[i].second]);
+		}
+	}
+
+	void Scene::UpdateLightPool()
+	{
+		m_LightPool.Resize(static_cast<uint32_t>(m_Lights.size()));
+		for (uint32_t i = 0; i < m_Lights.size(); ++i)
+		{
+			m_LightPool.Set(i, m_Lights[i]);
+		}
+	}
+
+	void Scene::UpdateContentHash()
+	{
+		const auto hashFloats = [](const std::vector<float>& values, uint64_t hash) { return HashBytes(values.data(), values.size() * sizeof(float), hash); };
+
+		//The pools are plain floats without padding bytes, the structs they are built from are not
+		uint64_t hash{ HashSeed };
+		for (const std::vector<float>* pValues : { &m_SpherePool.x, &m_SpherePool.y, &m_SpherePool.z, &m_SpherePool.radiusSquared,
+			&m_LightPool.x, &m_LightPool.y, &m_LightPool.z, &m_LightPool.positional, &m_LightPool.red, &m_LightPool.green, &m_LightPool.blue })
+		{
+			hash = hashFloats(*pValues, hash);
 		}
 
 		for (const Plane& plane : m_PlaneGeometries)
 		{
-			GeometryUtils::HitTest_Plane(plane, ray, closestHit);
+			hash = HashBytes(&plane.origin, sizeof(Vector3), hash);
+			hash = HashBytes(&plane.normal, sizeof(Vector3), hash);
 		}
-		for (const TriangleMesh& triagleMesh : m_TriangleMeshGeometries)
+
+		for (const Triangle& triangle : m_Triangles)
 		{
-			GeometryUtils::HitTest_TriangleMesh(triagleMesh, ray, closestHit);
+			hash = HashBytes(&triangle.v0, sizeof(Vector3), hash);
+			hash = HashBytes(&triangle.v1, sizeof(Vector3), hash);
+			hash = HashBytes(&triangle.v2, sizeof(Vector3), hash);
 		}
-		for (const Triangle& triagle : m_Triangles)
+
+		for (const TriangleMesh& mesh : m_TriangleMeshGeometries)
 		{
-			GeometryUtils::HitTest_Triangle(triagle, ray, closestHit);
+			hash = HashBytes(&mesh.worldTransform, sizeof(Matrix), hash);
+			if (mesh.isDeforming)
+				hash = HashBytes(mesh.positions.data(), mesh.positions.size() * sizeof(Vector3), hash);
 		}
 
+		m_ContentHash = hash;
 	}
 
-	bool Scene::DoesHit(const Ray& ray) const
+	void Scene::UpdatePointInvariants(const Vector3& point, PointInvariants& invariants) const
 	{
-		//todo W3
-		for (const Sphere& sphere : m_SphereGeometries)
+		invariants.Update(point, m_SpherePool, m_PlaneGeometries);
+	}
+
+	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit, const PointInvariants* pInvariants) const
+	{
+		assert(!pInvariants || (pInvariants->point.x == ray.origin.x && pInvariants->point.y == ray.origin.y && pInvariants->point.z == ray.origin.z));
+
+		for (size_t i = 0; i < m_PlaneGeometries.size(); ++i)
 		{
-			if (GeometryUtils::HitTest_Sphere(sphere, ray)) return true;
-		}			
-		for (const Plane& plane : m_PlaneGeometries)
+			if (pInvariants)
+				GeometryUtils::HitTest_Plane(m_PlaneGeometries[i], pInvariants->planeDistances[i], ray, closestHit);
+			else
+				GeometryUtils::HitTest_Plane(m_PlaneGeometries[i], ray, closestHit);
+		}
+
+		GeometryUtils::Traverse_BVH(m_TopLevelBVH, ray, closestHit, [&](uint32_t first, uint32_t count)
+			{
+				for (uint32_t i = first; i < first + count; ++i)
+				{
+					const PrimitiveReference& primitive = m_Primitives[m_TopLevelBVH.primitiveIndices[i]];
+
+					switch (primitive.type)
+					{
+					case PrimitiveType::SphereGroup:
+						GeometryUtils::HitTest_SphereGroup(m_SpherePool, primitive.index, ray, closestHit, pInvariants);
+						break;
+					case PrimitiveType::Triangle:
+						GeometryUtils::HitTest_Triangle(m_Triangles[primitive.index], ray, closestHit);
+						break;
+					case PrimitiveType::TriangleMesh:
+						GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[primitive.index], ray, closestHit);
+						break;
+					}
+				}
+			});
+	}
+
+	void Scene::GetClosestHits(RayPacket& packet, HitRecord* pClosestHits, const PointInvariants* pInvariants) const
+	{
+		assert(!pInvariants || (pInvariants->point.x == packet.origin.x && pInvariants->point.y == packet.origin.y && pInvariants->point.z == packet.origin.z));
+
+		//Directions that straddle an axis defeat the interval test, such packets are traced ray by ray
+		if (!packet.isCoherent)
 		{
-			if (GeometryUtils::HitTest_Plane(plane, ray)) return true;
+			GeometryUtils::ForEachLane(packet, packet.mask, pClosestHits, [&](const Ray& ray, HitRecord& closestHit) { GetClosestHit(ray, closestHit, pInvariants); });
+			return;
 		}
-		for (const Triangle& triagle : m_Triangles)
+
+		for (size_t i = 0; i < m_PlaneGeometries.size(); ++i)
 		{
-			if (GeometryUtils::HitTest_Triangle(triagle, ray)) return true;
+			if (pInvariants)
+				GeometryUtils::HitTest_Plane(m_PlaneGeometries[i], pInvariants->planeDistances[i], packet, packet.mask, pClosestHits);
+			else
+				GeometryUtils::HitTest_Plane(m_PlaneGeometries[i], packet, packet.mask, pClosestHits);
 		}
-		for (const TriangleMesh& triagleMesh : m_TriangleMeshGeometries)
+
+		GeometryUtils::Traverse_BVH(m_TopLevelBVH, packet, packet.mask, [&](uint32_t first, uint32_t count, uint32_t mask)
+			{
+				for (uint32_t i = first; i < first + count; ++i)
+				{
+					const PrimitiveReference& primitive = m_Primitives[m_TopLevelBVH.primitiveIndices[i]];
+
+					switch (primitive.type)
+					{
+					case PrimitiveType::SphereGroup:
+						GeometryUtils::ForEachLane(packet, mask, pClosestHits, [&](const Ray& ray, HitRecord& closestHit)
+							{
+								GeometryUtils::HitTest_SphereGroup(m_SpherePool, primitive.index, ray, closestHit, pInvariants);
+							});
+						break;
+					case PrimitiveType::Triangle:
+						GeometryUtils::ForEachLane(packet, mask, pClosestHits, [&](const Ray& ray, HitRecord& closestHit)
+							{
+								GeometryUtils::HitTest_Triangle(m_Triangles[primitive.index], ray, closestHit);
+							});
+						break;
+					case PrimitiveType::TriangleMesh:
+						GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[primitive.index], packet, mask, pClosestHits);
+						break;
+					}
+				}
+			});
+	}
+
+	//Occlusion query for shadow rays, only reports whether anything lies within [ray.min, ray.max).
+	//pInvariants, optional, belong to the point the ray ends at, ray.origin + ray.max * ray.direction. Spheres and planes then test
+	//the ray backwards from that point with the shared terms, triangles keep the forward ray so their culling is unchanged
+	bool Scene::DoesHit(const Ray& ray, const PointInvariants* pInvariants) const
+	{
+		Ray backwardRay{};
+		if (pInvariants)
 		{
-			if(GeometryUtils::HitTest_TriangleMesh(triagleMesh, ray)) return true;
+			backwardRay.origin = pInvariants->point;
+			backwardRay.direction = -ray.direction;
+			backwardRay.max = ray.max - ray.min;
 		}
-		
-		return false;
+
+		for (size_t i = 0; i < m_PlaneGeometries.size(); ++i)
+		{
+			if (pInvariants ? GeometryUtils::OcclusionTest_Plane(m_PlaneGeometries[i], pInvariants->planeDistances[i], backwardRay)
+				: GeometryUtils::OcclusionTest_Plane(m_PlaneGeometries[i], ray)) return true;
+		}
+
+		return GeometryUtils::TraverseAnyHit_BVH(m_TopLevelBVH, ray, [&](uint32_t first, uint32_t count)
+			{
+				for (uint32_t i = first; i < first + count; ++i)
+				{
+					const PrimitiveReference& primitive = m_Primitives[m_TopLevelBVH.primitiveIndices[i]];
+
+					switch (primitive.type)
+					{
+					case PrimitiveType::SphereGroup:
+						if (pInvariants ? GeometryUtils::OcclusionTest_SphereGroup(m_SpherePool, primitive.index, backwardRay, pInvariants)
+							: GeometryUtils::OcclusionTest_SphereGroup(m_SpherePool, primitive.index, ray)) return true;
+						break;
+					case PrimitiveType::Triangle:
+						if (GeometryUtils::OcclusionTest_Triangle(m_Triangles[primitive.index], ray)) return true;
+						break;
+					case PrimitiveType::TriangleMesh:
+						if (GeometryUtils::OcclusionTest_TriangleMesh(m_TriangleMeshGeometries[primitive.index], ray)) return true;
+						break;
+					}
+				}
+				return false;
+			});
 	}
 
 #pragma region Scene Helpers
@@ -101,7 +294,7 @@ namespace dae {
 		m.cullMode = cullMode;
 		m.materialIndex = materialIndex;
 
-		m_TriangleMeshGeometries.emplace_back(m);
+		m_TriangleMeshGeometries.emplace_back(std::move(m));
 		return &m_TriangleMeshGeometries.back();
 	}
 
@@ -129,9 +322,9 @@ namespace dae {
 		return &m_Lights.back();
 	}
 
-	unsigned char Scene::AddMaterial(Material* pMaterial)
+	unsigned char Scene::AddMaterial(const Material& material)
 	{
-		m_Materials.push_back(pMaterial);
+		m_Materials.push_back(material);
 		return static_cast<unsigned char>(m_Materials.size() - 1);
 	}
 #pragma endregion
@@ -142,11 +335,11 @@ namespace dae {
 	{
 		//default: Material id0 >> SolidColor Material (RED)
 		constexpr unsigned char matId_Solid_Red = 0;
-		const unsigned char matId_Solid_Blue = AddMaterial(new Material_SolidColor{ colors::Blue });
+		const unsigned char matId_Solid_Blue = AddMaterial(Material::SolidColor(colors::Blue));
 
-		const unsigned char matId_Solid_Yellow = AddMaterial(new Material_SolidColor{ colors::Yellow });
-		const unsigned char matId_Solid_Green = AddMaterial(new Material_SolidColor{ colors::Green });
-		const unsigned char matId_Solid_Magenta = AddMaterial(new Material_SolidColor{ colors::Magenta });
+		const unsigned char matId_Solid_Yellow = AddMaterial(Material::SolidColor(colors::Yellow));
+		const unsigned char matId_Solid_Green = AddMaterial(Material::SolidColor(colors::Green));
+		const unsigned char matId_Solid_Magenta = AddMaterial(Material::SolidColor(colors::Magenta));
 
 		//Spheres
 		AddSphere({ -25.f, 0.f, 100.f }, 50.f, matId_Solid_Red);
@@ -167,10 +360,10 @@ namespace dae {
 
 		constexpr unsigned char matId_Solid_Red = 0;
 
-		const unsigned char matId_Solid_Blue = AddMaterial(new Material_SolidColor{ colors::Blue });
-		const unsigned char matId_Solid_Yellow = AddMaterial(new Material_SolidColor{ colors::Yellow });
-		const unsigned char matId_Solid_Green = AddMaterial(new Material_SolidColor{ colors::Green });
-		const unsigned char matId_Solid_Magenta = AddMaterial(new Material_SolidColor{ colors::Magenta });
+		const unsigned char matId_Solid_Blue = AddMaterial(Material::SolidColor(colors::Blue));
+		const unsigned char matId_Solid_Yellow = AddMaterial(Material::SolidColor(colors::Yellow));
+		const unsigned char matId_Solid_Green = AddMaterial(Material::SolidColor(colors::Green));
+		const unsigned char matId_Solid_Magenta = AddMaterial(Material::SolidColor(colors::Magenta));
 
 		// planes
 		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matId_Solid_Magenta); //BACK
@@ -197,16 +390,16 @@ namespace dae {
 
 	//	//default: Material id0 >> SolidColor Material (RED)
 	//	constexpr unsigned char matId_Solid_Red = 0;
-	//	const unsigned char matId_Solid_Blue = AddMaterial(new Material_SolidColor{ colors::Blue });
-	//	const unsigned char matId_Solid_Yellow = AddMaterial(new Material_SolidColor{ colors::Yellow });
+	//	const unsigned char matId_Solid_Blue = AddMaterial(Material::SolidColor(colors::Blue));
+	//	const unsigned char matId_Solid_Yellow = AddMaterial(Material::SolidColor(colors::Yellow));
 
-	//	const unsigned char matId_Lambert_Yellow = AddMaterial(new Material_Lambert{ colors::Yellow , 1.f});
-	//	const unsigned char matId_Lambert_Blue = AddMaterial(new Material_Lambert{ colors::Blue , 1.f});
-	//	const unsigned char matId_Lambert_Red = AddMaterial(new Material_Lambert{ colors::Red , 1.f});
-	//	//const unsigned char matId_Solid_Red = AddMaterial(new Material_SolidColor{ colors::Red });
-	//	const auto matLambertPhong3 = AddMaterial(new Material_LambertPhong(colors::Blue, 4.0f, 2.f, 10.f));
+	//	const unsigned char matId_Lambert_Yellow = AddMaterial(Material::Lambert(colors::Yellow , 1.f));
+	//	const unsigned char matId_Lambert_Blue = AddMaterial(Material::Lambert(colors::Blue , 1.f));
+	//	const unsigned char matId_Lambert_Red = AddMaterial(Material::Lambert(colors::Red , 1.f));
+	//	//const unsigned char matId_Solid_Red = AddMaterial(Material::SolidColor(colors::Red));
+	//	const auto matLambertPhong3 = AddMaterial(Material::LambertPhong(colors::Blue, 4.0f, 2.f, 10.f));
 
-	//	const auto matCT_GraySmoothPlastic = AddMaterial(new Material_CookTorrence({ 0.f, 0.f, 0.f }, 1.f, 0.5f));
+	//	const auto matCT_GraySmoothPlastic = AddMaterial(Material::CookTorrence({ 0.f, 0.f, 0.f }, 1.f, 0.5f));
 
 
 	//	//Spheres
@@ -227,16 +420,16 @@ namespace dae {
 		m_Camera.origin = { 0,3,-9 };
 		m_Camera.fovAngle = 45.f;
 
-		const auto matCT_GrayRoughMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, 1.f));
-		const auto matCT_GrayMediumMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .5f));
-		const auto matCT_GraySmoothMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .01f));
+		const auto matCT_GrayRoughMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, 1.f));
+		const auto matCT_GrayMediumMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, .5f));
+		const auto matCT_GraySmoothMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, .01f));
 
-		const auto matCT_GrayRoughPlastic = AddMaterial(new Material_CookTorrence({ 1.f, 1.f, 1.f }, 0.0f, 1.0f));
-		const auto matCT_GrayMediumPlastic = AddMaterial(new Material_CookTorrence({ 1.f, 1.f, 1.f }, 0.0f, 0.2f));
-		const auto matCT_GraySmoothPlastic = AddMaterial(new Material_CookTorrence({ 1.f, 1.f, 1.f }, 0.0f, 0.01f));
+		const auto matCT_GrayRoughPlastic = AddMaterial(Material::CookTorrence({ 1.f, 1.f, 1.f }, 0.0f, 1.0f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(Material::CookTorrence({ 1.f, 1.f, 1.f }, 0.0f, 0.2f));
+		const auto matCT_GraySmoothPlastic = AddMaterial(Material::CookTorrence({ 1.f, 1.f, 1.f }, 0.0f, 0.01f));
 		
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, 0.57f, 0.57f }, 1.f));
-		//const auto matLambertPhong3 = AddMaterial(new Material_CookTorrence(colors::Blue, 0.5f, 0.5f, 50.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material::Lambert({ .49f, 0.57f, 0.57f }, 1.f));
+		//const auto matLambertPhong3 = AddMaterial(Material::CookTorrence(colors::Blue, 0.5f, 0.5f, 50.f));
 
 		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
 		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_GrayBlue); //BOTTOM
@@ -274,15 +467,15 @@ namespace dae {
 		m_Camera.origin = { 0,3,-9 };
 		m_Camera.fovAngle = 45.f;
 
-		const auto matCT_GrayRoughMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, 1.f));
-		const auto matCT_GrayMediumMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .6f));
-		const auto matCT_GraySmoothMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .1f));
-		const auto matCT_GrayRoughPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, 1.f));
-		const auto matCT_GrayMediumPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, .6f));
-		const auto matCT_GraySmoothPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, .1f));
+		const auto matCT_GrayRoughMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, 1.f));
+		const auto matCT_GrayMediumMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, .6f));
+		const auto matCT_GraySmoothMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, .1f));
+		const auto matCT_GrayRoughPlastic = AddMaterial(Material::CookTorrence({ .75f, .75f, .75f }, .0f, 1.f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(Material::CookTorrence({ .75f, .75f, .75f }, .0f, .6f));
+		const auto matCT_GraySmoothPlastic = AddMaterial(Material::CookTorrence({ .75f, .75f, .75f }, .0f, .1f));
 
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, 0.57f, 0.57f }, 1.f));
-		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material::Lambert({ .49f, 0.57f, 0.57f }, 1.f));
+		const auto matLambert_White = AddMaterial(Material::Lambert(colors::White, 1.f));
 
 		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
 		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_GrayBlue); //BOTTOM
@@ -304,18 +497,21 @@ namespace dae {
 		m_Meshes[0]->AppendTriangle(baseTriangle, true);
 		m_Meshes[0]->Translate({ -1.75f,4.5f,0.f });
 		m_Meshes[0]->UpdateAABB();
+		m_Meshes[0]->UpdateBVH();
 		m_Meshes[0]->UpdateTransforms();
 
 		m_Meshes[1] = AddTriangleMesh(TriangleCullMode::FrontFaceCulling, matLambert_White);
 		m_Meshes[1]->AppendTriangle(baseTriangle, true);
 		m_Meshes[1]->Translate({ 0.f,4.5f,0.f });
 		m_Meshes[1]->UpdateAABB();
+		m_Meshes[1]->UpdateBVH();
 		m_Meshes[1]->UpdateTransforms();
 
 		m_Meshes[2] = AddTriangleMesh(TriangleCullMode::NoCulling, matLambert_White);
 		m_Meshes[2]->AppendTriangle(baseTriangle, true);
 		m_Meshes[2]->Translate({ 1.75f,4.5f,0.f });
 		m_Meshes[2]->UpdateAABB();
+		m_Meshes[2]->UpdateBVH();
 		m_Meshes[2]->UpdateTransforms();
 
 		AddPointLight(Vector3{ 0.f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f, .61f, .45f }); //Backlight
@@ -344,8 +540,8 @@ namespace dae {
 		m_Camera.origin = { 0,3,-9 };
 		m_Camera.fovAngle = 45.f;
 
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, 0.57f, 0.57f }, 1.f));
-		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material::Lambert({ .49f, 0.57f, 0.57f }, 1.f));
+		const auto matLambert_White = AddMaterial(Material::Lambert(colors::White, 1.f));
 
 		//Planes
 		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
@@ -363,6 +559,7 @@ namespace dae {
 
 		pMesh->Scale({ 2.f, 2.f, 2.f });
 		pMesh->UpdateAABB();
+		pMesh->UpdateBVH();
 		pMesh->UpdateTransforms();
 
 
@@ -380,5 +577,45 @@ namespace dae {
 		pMesh->RotateY(yawAngle);
 		pMesh->UpdateTransforms();
 	}
+
+	void Scene_SphereStress::Initialize()
+	{
+		sceneName = "Sphere Stress Scene";
+		m_TopLevelBuildQuality = BVHBuildQuality::Linear;
+		m_Camera.origin = { 0.f, 3.f, -9.f };
+		m_Camera.fovAngle = 45.f;
+
+		constexpr unsigned char matId_Solid_Red = 0;
+		const unsigned char matId_Solid_Blue = AddMaterial(Material::SolidColor(colors::Blue));
+		const unsigned char matId_Solid_Yellow = AddMaterial(Material::SolidColor(colors::Yellow));
+		const unsigned char matId_Solid_Green = AddMaterial(Material::SolidColor(colors::Green));
+		const unsigned char matId_Solid_Magenta = AddMaterial(Material::SolidColor(colors::Magenta));
+
+		// planes
+		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matId_Solid_Magenta); //BACK
+		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matId_Solid_Yellow); //BOTTOM
+		AddPlane(Vector3{ 0.f, 10.f, 0.f }, Vector3{ 0.f, -1.f, 0.f }, matId_Solid_Yellow); //TOP
+		AddPlane(Vector3{ 5.f, 0.f, 0.f }, Vector3{ -1.f, 0.f, 0.f }, matId_Solid_Green); //RIGHT
+		AddPlane(Vector3{ -5.f, 0.f, 0.f }, Vector3{ 1.f, 0.f, 0.f }, matId_Solid_Green); //LEFT
+
+		//16 x 16 x 8 spheres, alternating red and blue like Scene_W2
+		constexpr int columns{ 16 }, rows{ 16 }, layers{ 8 };
+		constexpr float spacing{ .5f };
+
+		m_SphereGeometries.reserve(columns * rows * layers);
+		for (int layer = 0; layer < layers; ++layer)
+		{
+			for (int row = 0; row < rows; ++row)
+			{
+				for (int column = 0; column < columns; ++column)
+				{
+					const Vector3 origin{ (column - (columns - 1) * .5f) * spacing, .5f + row * spacing, layer * spacing };
+					AddSphere(origin, .2f, (column + row + layer) % 2 == 0 ? matId_Solid_Red : matId_Solid_Blue);
+				}
+			}
+		}
+
+		AddPointLight(Vector3{ 0.f, 5.f, -5.f }, 75.f, colors::White); //Backlight
+	}
 #pragma endregion
 }
@@ -5,16 +5,30 @@
 #include "Math.h"
 #include "DataTypes.h"
 #include "Camera.h"
+#include "Material.h"
 
 namespace dae
 {
 	//Forward Declarations
 	class Timer;
-	class Material;
 	struct Plane;
 	struct Sphere;
 	struct Light;
 
+	//What a top level BVH leaf entry points at
+	enum class PrimitiveType : uint8_t
+	{
+		SphereGroup,
+		Triangle,
+		TriangleMesh
+	};
+
+	struct PrimitiveReference
+	{
+		PrimitiveType type{};
+		uint32_t index{};
+	};
+
 	//Scene Base Class
 	class Scene
 	{
@@ -34,13 +48,24 @@ namespace dae
 		}
 
 		Camera& GetCamera() { return m_Camera; }
-		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
-		bool DoesHit(const Ray& ray) const;
+		void UpdateTopLevelBVH();
+		//pInvariants, optional, must belong to the ray origin, see UpdatePointInvariants
+		void GetClosestHit(const Ray& ray, HitRecord& closestHit, const PointInvariants* pInvariants = nullptr) const;
+		//GetClosestHit for every lane of a prepared packet, pClosestHits holds one record per lane.
+		//pInvariants, optional, must belong to the packet origin
+		void GetClosestHits(RayPacket& packet, HitRecord* pClosestHits, const PointInvariants* pInvariants = nullptr) const;
+		//pInvariants, optional, must belong to the point the ray ends at, ray.origin + ray.max * ray.direction
+		bool DoesHit(const Ray& ray, const PointInvariants* pInvariants = nullptr) const;
+		//Fills invariants for point from the current sphere pool and planes, so after UpdateTopLevelBVH
+		void UpdatePointInvariants(const Vector3& point, PointInvariants& invariants) const;
+		//Hash of the geometry and lights as of the last UpdateTopLevelBVH, it stays the same as long as nothing moves
+		uint64_t GetContentHash() const { return m_ContentHash; }
 
 		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
 		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
 		const std::vector<Light>& GetLights() const { return m_Lights; }
-		const std::vector<Material*> GetMaterials() const { return m_Materials; }
+		const LightPool& GetLightPool() const { return m_LightPool; }
+		const std::vector<Material>& GetMaterials() const { return m_Materials; }
 
 	protected:
 		std::string	sceneName;
@@ -49,19 +74,37 @@ namespace dae
 		std::vector<Sphere> m_SphereGeometries{};
 		std::vector<TriangleMesh> m_TriangleMeshGeometries{};
 		std::vector<Light> m_Lights{};
-		std::vector<Material*> m_Materials{};
+		std::vector<Material> m_Materials{};
 
 		std::vector<Triangle> m_Triangles;
 
+		//Top level over everything with finite bounds: sphere groups, loose triangles and mesh instances, the latter keep their own object space BVH.
+		//Planes are unbounded and tested up front, which also gives the traversal a tighter t to cull against
+		BVH m_TopLevelBVH{};
+		BVHBuildQuality m_TopLevelBuildQuality{ BVHBuildQuality::SAH }; //rebuilt every frame, Linear pays off for many primitives
+		std::vector<PrimitiveReference> m_Primitives{};
+
+		//m_SphereGeometries repacked every frame, Morton ordered so the spheres of a group lie close together
+		SpherePool m_SpherePool{};
+		//m_Lights repacked every frame in their original order, the shading sums them in that order
+		LightPool m_LightPool{};
+
 		Camera m_Camera{};
 
+		uint64_t m_ContentHash{};
+
 		Sphere* AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
 		Plane* AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
 		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
 
 		Light* AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
 		Light* AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
-		unsigned char AddMaterial(Material* pMaterial);
+		unsigned char AddMaterial(const Material& material);
+
+	private:
+		void UpdateSpherePool();
+		void UpdateLightPool();
+		void UpdateContentHash();
 	};
 
 	//+++++++++++++++++++++++++++++++++++++++++
@@ -146,4 +189,19 @@ namespace dae
 	private:
 		TriangleMesh* pMesh{ nullptr };
 	};
+
+	//Scene_W2 with its two rows of spheres grown into a block of thousands, scales with the top level BVH instead of the sphere count
+	class Scene_SphereStress final : public Scene
+	{
+	public:
+		Scene_SphereStress() = default;
+		~Scene_SphereStress() override = default;
+
+		Scene_SphereStress(const Scene_SphereStress&) = delete;
+		Scene_SphereStress(Scene_SphereStress&&) noexcept = delete;
+		Scene_SphereStress& operator=(const Scene_SphereStress&) = delete;
+		Scene_SphereStress& operator=(Scene_SphereStress&&) noexcept = delete;
+
+		void Initialize() override;
+	};
 }
@@ -0,0 +1,323 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <fstream>
+#include <string>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace dae {
+
+	namespace
+	{
+		using Clock = std::chrono::high_resolution_clock;
+
+		uint64_t PackRange(uint32_t front, uint32_t back)
+		{
+			return uint64_t(front) | (uint64_t(back) << 32);
+		}
+
+		bool PinThread(std::thread& thread, uint32_t processor)
+		{
+#if defined(_WIN32)
+			return SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << processor) != 0;
+#elif defined(__linux__)
+			cpu_set_t processors;
+			CPU_ZERO(&processors);
+			CPU_SET(processor, &processors);
+			return pthread_setaffinity_np(thread.native_handle(), sizeof(processors), &processors) == 0;
+#else
+			return false;
+#endif
+		}
+	}
+
+	std::vector<std::vector<uint32_t>> ThreadPool::GetProcessorCores()
+	{
+		std::vector<std::vector<uint32_t>> cores{};
+
+#if defined(_WIN32)
+		DWORD length{};
+		GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+		std::vector<char> buffer(length);
+		DWORD_PTR processMask{}, systemMask{};
+		GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask);
+
+		if (GetLogicalProcessorInformationEx(RelationProcessorCore, reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data()), &length))
+		{
+			for (DWORD offset{ 0 }; offset < length;)
+			{
+				const auto* pInformation = reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset);
+				offset += pInformation->Size;
+
+				//SetThreadAffinityMask only reaches the group the process started in
+				const GROUP_AFFINITY& affinity = pInformation->Processor.GroupMask[0];
+				if (affinity.Group != 0)
+					continue;
+
+				std::vector<uint32_t> core{};
+				for (uint32_t processor{ 0 }; processor < sizeof(KAFFINITY) * 8; ++processor)
+				{
+					if ((affinity.Mask & processMask) & (KAFFINITY(1) << processor))
+						core.emplace_back(processor);
+				}
+
+				if (!core.empty())
+					cores.emplace_back(std::move(core));
+			}
+		}
+#elif defined(__linux__)
+		cpu_set_t processors;
+		CPU_ZERO(&processors);
+		if (sched_getaffinity(0, sizeof(processors), &processors) == 0)
+		{
+			//Ordered by package and core id, the SMT siblings of a core share both
+			std::map<std::pair<int, int>, std::vector<uint32_t>> coreProcessors{};
+			for (uint32_t processor{ 0 }; processor < CPU_SETSIZE; ++processor)
+			{
+				if (!CPU_ISSET(processor, &processors))
+					continue;
+
+				const std::string topology{ "/sys/devices/system/cpu/cpu" + std::to_string(processor) + "/topology/" };
+				int package{ 0 }, core{ static_cast<int>(processor) };
+				std::ifstream{ topology + "physical_package_id" } >> package;
+				std::ifstream{ topology + "core_id" } >> core;
+				coreProcessors[{ package, core }].emplace_back(processor);
+			}
+
+			for (auto& [id, core] : coreProcessors)
+			{
+				cores.emplace_back(std::move(core));
+			}
+		}
+#endif
+
+		//No topology: every hardware thread its own core
+		if (cores.empty())
+		{
+			for (uint32_t processor{ 0 }; processor < std::max(std::thread::hardware_concurrency(), 1u); ++processor)
+			{
+				cores.push_back({ processor });
+			}
+		}
+
+		return cores;
+	}
+
+	ThreadPool::ThreadPool(const Configuration& configuration)
+	{
+		const std::vector<std::vector<uint32_t>> cores{ GetProcessorCores() };
+
+		//Usable processors in the order the affinity policy hands them out
+		std::vector<uint32_t> processors{};
+		const size_t siblings{ configuration.useSMT ? std::max_element(cores.begin(), cores.end(), [](const auto& a, const auto& b) { return a.size() < b.size(); })->size() : 1 };
+		if (configuration.affinity == Affinity::Compact)
+		{
+			for (const std::vector<uint32_t>& core : cores)
+			{
+				processors.insert(processors.end(), core.begin(), core.begin() + std::min(core.size(), siblings));
+			}
+		}
+		else
+		{
+			for (size_t sibling{ 0 }; sibling < siblings; ++sibling)
+			{
+				for (const std::vector<uint32_t>& core : cores)
+				{
+					if (sibling < core.size())
+						processors.emplace_back(core[sibling]);
+				}
+			}
+		}
+
+		const uint32_t threadCount{ configuration.threadCount > 0 ? configuration.threadCount : static_cast<uint32_t>(processors.size()) };
+
+		//More threads than processors wrap around
+		if (configuration.affinity != Affinity::None)
+		{
+			for (uint32_t worker{ 0 }; worker < threadCount; ++worker)
+			{
+				m_Processors.emplace_back(processors[worker % processors.size()]);
+			}
+		}
+
+		m_Workers.reserve(threadCount);
+		for (uint32_t worker{ 0 }; worker < threadCount; ++worker)
+		{
+			m_Workers.emplace_back(std::make_unique<Worker>());
+		}
+
+		//Worker 0 is whoever calls Run
+		m_Threads.reserve(threadCount - 1);
+		for (uint32_t worker{ 1 }; worker < threadCount; ++worker)
+		{
+			m_Threads.emplace_back(&ThreadPool::ThreadLoop, this, worker);
+			if (!m_Processors.empty())
+				PinThread(m_Threads.back(), m_Processors[worker]);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_Stopping = true;
+		}
+		m_WakeUp.notify_all();
+
+		for (std::thread& thread : m_Threads)
+		{
+			thread.join();
+		}
+	}
+
+	void ThreadPool::Run(uint32_t taskCount, const Task& task)
+	{
+		const Clock::time_point start = Clock::now();
+
+		const uint32_t threadCount{ GetThreadCount() };
+		for (uint32_t worker{ 0 }; worker < threadCount; ++worker)
+		{
+			Worker& state = *m_Workers[worker];
+			const uint32_t front{ static_cast<uint32_t>(uint64_t(taskCount) * worker / threadCount) };
+			const uint32_t back{ static_cast<uint32_t>(uint64_t(taskCount) * (worker + 1) / threadCount) };
+			state.range.store(PackRange(front, back), std::memory_order_relaxed);
+			state.busy = 0.f;
+			state.tasks = 0;
+			state.steals = 0;
+		}
+
+		m_pTask = &task;
+
+		if (threadCount > 1)
+		{
+			{
+				std::lock_guard lock{ m_Mutex };
+				m_ActiveThreads = threadCount - 1;
+				++m_Generation;
+			}
+			m_WakeUp.notify_all();
+		}
+
+		Work(0);
+
+		if (threadCount > 1)
+		{
+			std::unique_lock lock{ m_Mutex };
+			m_Finished.wait(lock, [this]() { return m_ActiveThreads == 0; });
+		}
+
+		m_pTask = nullptr;
+
+		m_Statistics = Statistics{};
+		m_Statistics.wall = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+
+		float totalBusy{}, maxBusy{};
+		for (const std::unique_ptr<Worker>& pWorker : m_Workers)
+		{
+			totalBusy += pWorker->busy;
+			maxBusy = std::max(maxBusy, pWorker->busy);
+			m_Statistics.tasks += pWorker->tasks;
+			m_Statistics.steals += pWorker->steals;
+		}
+
+		const float averageBusy{ totalBusy / threadCount };
+		m_Statistics.overhead = std::max(m_Statistics.wall - averageBusy, 0.f);
+		m_Statistics.imbalance = averageBusy > 0.f ? maxBusy / averageBusy : 1.f;
+	}
+
+	void ThreadPool::ThreadLoop(uint32_t worker)
+	{
+		uint64_t generation{};
+
+		while (true)
+		{
+			{
+				std::unique_lock lock{ m_Mutex };
+				m_WakeUp.wait(lock, [&]() { return m_Stopping || m_Generation != generation; });
+				if (m_Stopping)
+					return;
+				generation = m_Generation;
+			}
+
+			Work(worker);
+
+			{
+				std::lock_guard lock{ m_Mutex };
+				--m_ActiveThreads;
+			}
+			m_Finished.notify_one();
+		}
+	}
+
+	void ThreadPool::Work(uint32_t worker)
+	{
+		Worker& self = *m_Workers[worker];
+		const uint32_t threadCount{ GetThreadCount() };
+
+		//Ranges only shrink during a Run, once every one of them is empty there is nothing left to take
+		while (true)
+		{
+			uint32_t task{};
+			bool found{ TakeFront(self, task) };
+
+			for (uint32_t offset{ 1 }; !found && offset < threadCount; ++offset)
+			{
+				found = TakeBack(*m_Workers[(worker + offset) % threadCount], task);
+				if (found)
+					++self.steals;
+			}
+
+			if (!found)
+				return;
+
+			const Clock::time_point start = Clock::now();
+			(*m_pTask)(task, worker);
+			self.busy += std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+			++self.tasks;
+		}
+	}
+
+	bool ThreadPool::TakeFront(Worker& worker, uint32_t& task)
+	{
+		uint64_t range{ worker.range.load(std::memory_order_relaxed) };
+		while (true)
+		{
+			const uint32_t front{ static_cast<uint32_t>(range) }, back{ static_cast<uint32_t>(range >> 32) };
+			if (front >= back)
+				return false;
+
+			if (worker.range.compare_exchange_weak(range, PackRange(front + 1, back), std::memory_order_relaxed))
+			{
+				task = front;
+				return true;
+			}
+		}
+	}
+
+	bool ThreadPool::TakeBack(Worker& worker, uint32_t& task)
+	{
+		uint64_t range{ worker.range.load(std::memory_order_relaxed) };
+		while (true)
+		{
+			const uint32_t front{ static_cast<uint32_t>(range) }, back{ static_cast<uint32_t>(range >> 32) };
+			if (front >= back)
+				return false;
+
+			if (worker.range.compare_exchange_weak(range, PackRange(front, back - 1), std::memory_order_relaxed))
+			{
+				task = back - 1;
+				return true;
+			}
+		}
+	}
+}
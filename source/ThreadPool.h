@@ -0,0 +1,96 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	//Persistent workers for the render loop, started once instead of once per frame.
+	//Run splits the tasks into one contiguous range per worker, a worker takes tasks from the front of its own range
+	//and steals from the back of the others once it runs dry, so neighbouring tasks mostly stay on the same thread
+	class ThreadPool final
+	{
+	public:
+		//Task index and the index of the worker running it, [0, GetThreadCount())
+		using Task = std::function<void(uint32_t task, uint32_t worker)>;
+
+		//Timings of the last Run
+		struct Statistics
+		{
+			float wall{}; //ms from the start of Run until the last task finished
+			float overhead{}; //ms of the wall time the average worker did not spend in a task: waking up, stealing, waiting
+			float imbalance{}; //task time of the busiest worker over the average one, 1 is perfectly balanced
+			uint32_t tasks{};
+			uint32_t steals{};
+		};
+
+		//How the pool's threads are pinned to logical processors
+		enum class Affinity
+		{
+			None, //left to the OS
+			Compact, //fills a physical core with its SMT siblings before moving on to the next one
+			Scatter //one thread per physical core first, the SMT siblings only once every core has one
+		};
+
+		struct Configuration
+		{
+			uint32_t threadCount{}; //0: one per usable logical processor
+			Affinity affinity{ Affinity::None };
+			bool useSMT{ true }; //false: only the first logical processor of every physical core is usable
+		};
+
+		//The thread calling Run is worker 0 and keeps its own affinity, the pool's threads take the processors after it
+		explicit ThreadPool(const Configuration& configuration);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) noexcept = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) noexcept = delete;
+
+		//Runs task for every index in [0, taskCount) and returns once all of them are done
+		void Run(uint32_t taskCount, const Task& task);
+
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()); }
+		//Logical processor of every worker, empty when the affinity is None. Entry 0 is where worker 0 would go
+		const std::vector<uint32_t>& GetProcessors() const { return m_Processors; }
+		const Statistics& GetStatistics() const { return m_Statistics; }
+
+		//Logical processors this process may run on, grouped by physical core. Only processor group 0 on Windows
+		static std::vector<std::vector<uint32_t>> GetProcessorCores();
+
+	private:
+		//The remaining range of a worker packed as front | back << 32, the owner and the thieves both claim tasks with one CAS
+		struct alignas(64) Worker
+		{
+			std::atomic<uint64_t> range{};
+			float busy{}; //ms spent in tasks during the last Run
+			uint32_t tasks{};
+			uint32_t steals{};
+		};
+
+		std::vector<std::unique_ptr<Worker>> m_Workers{};
+		std::vector<uint32_t> m_Processors{};
+		std::vector<std::thread> m_Threads{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WakeUp{};
+		std::condition_variable m_Finished{};
+		uint64_t m_Generation{};
+		uint32_t m_ActiveThreads{};
+		bool m_Stopping{ false };
+
+		const Task* m_pTask{};
+		Statistics m_Statistics{};
+
+		void ThreadLoop(uint32_t worker);
+		void Work(uint32_t worker);
+		bool TakeFront(Worker& worker, uint32_t& task);
+		bool TakeBack(Worker& worker, uint32_t& task);
+	};
+}
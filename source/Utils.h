@@ -1,6 +1,8 @@
 ﻿#pragma once
 #include <cassert>
 #include <fstream>
+#include <bit>
+#include <immintrin.h>
 #include "Math.h"
 #include "DataTypes.h"
 #include <iostream>
@@ -78,6 +80,131 @@ namespace dae
 			HitRecord temp{};
 			return HitTest_Sphere(sphere, ray, temp, true);
 		}
+
+		//Tests every sphere of a pool group at once and keeps the closest t in range, the hit record is only filled for that one.
+		//Uses the half b form of the quadratic, t = (-b' -+ sqrt(b'^2 - ac)) / a with b' = Dot(direction, origin - center).
+		//pInvariants, optional, belong to the ray origin: c comes from them and b' is one dot per sphere, with the same bits as the full form
+		inline bool HitTest_SphereGroup(const SpherePool& spheres, uint32_t group, const Ray& ray, HitRecord& hitRecord, const PointInvariants* pInvariants = nullptr)
+		{
+			const uint32_t first{ group * SpherePool::GroupSize };
+			const float a = Vector3::Dot(ray.direction, ray.direction);
+			const float maxT = std::min(ray.max, hitRecord.t);
+
+			float closestT{ FLT_MAX };
+			uint32_t closestLane{ 0 };
+
+#if defined(__AVX2__)
+			static_assert(SpherePool::GroupSize == 8, "one AVX2 register per group");
+
+			const __m256 aVector = _mm256_set1_ps(a);
+			__m256 halfB{}, c{};
+			if (pInvariants)
+			{
+				halfB = _mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(_mm256_set1_ps(ray.direction.x), _mm256_loadu_ps(&pInvariants->toPointX[first])),
+					_mm256_mul_ps(_mm256_set1_ps(ray.direction.y), _mm256_loadu_ps(&pInvariants->toPointY[first]))),
+					_mm256_mul_ps(_mm256_set1_ps(ray.direction.z), _mm256_loadu_ps(&pInvariants->toPointZ[first])));
+				c = _mm256_loadu_ps(&pInvariants->sphereC[first]);
+			}
+			else
+			{
+				const __m256 toOriginX = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_loadu_ps(&spheres.x[first]));
+				const __m256 toOriginY = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_loadu_ps(&spheres.y[first]));
+				const __m256 toOriginZ = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_loadu_ps(&spheres.z[first]));
+
+				halfB = _mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(_mm256_set1_ps(ray.direction.x), toOriginX),
+					_mm256_mul_ps(_mm256_set1_ps(ray.direction.y), toOriginY)),
+					_mm256_mul_ps(_mm256_set1_ps(ray.direction.z), toOriginZ));
+				c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(toOriginX, toOriginX),
+					_mm256_mul_ps(toOriginY, toOriginY)),
+					_mm256_mul_ps(toOriginZ, toOriginZ)),
+					_mm256_loadu_ps(&spheres.radiusSquared[first]));
+			}
+
+			const __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(halfB, halfB), _mm256_mul_ps(aVector, c));
+
+			//Padding lanes and misses are masked out, their sqrt of a negative number never gets used
+			const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+			const __m256 valid = _mm256_and_ps(
+				_mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(spheres.GroupLanes(group))), lanes)),
+				_mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GT_OQ));
+
+			const __m256 sqrtDiscriminant = _mm256_sqrt_ps(_mm256_max_ps(discriminant, _mm256_setzero_ps()));
+			const __m256 inverseA = _mm256_set1_ps(1.f / a);
+			const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_setzero_ps(), halfB), sqrtDiscriminant), inverseA);
+			const __m256 t2 = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(_mm256_setzero_ps(), halfB), sqrtDiscriminant), inverseA);
+
+			const __m256 minT = _mm256_set1_ps(ray.min);
+			const __m256 maxTVector = _mm256_set1_ps(maxT);
+			const __m256 t1InRange = _mm256_and_ps(_mm256_cmp_ps(t1, minT, _CMP_GE_OQ), _mm256_cmp_ps(t1, maxTVector, _CMP_LT_OQ));
+			const __m256 t2InRange = _mm256_and_ps(_mm256_cmp_ps(t2, minT, _CMP_GE_OQ), _mm256_cmp_ps(t2, maxTVector, _CMP_LT_OQ));
+
+			//Near root if it is in range, else the far one (ray starts inside), else no hit
+			__m256 t = _mm256_blendv_ps(_mm256_set1_ps(FLT_MAX), t2, t2InRange);
+			t = _mm256_blendv_ps(t, t1, t1InRange);
+			t = _mm256_blendv_ps(_mm256_set1_ps(FLT_MAX), t, valid);
+
+			//Horizontal min, then the lowest lane holding it
+			__m256 reduced = _mm256_min_ps(t, _mm256_permute2f128_ps(t, t, 1));
+			reduced = _mm256_min_ps(reduced, _mm256_shuffle_ps(reduced, reduced, _MM_SHUFFLE(1, 0, 3, 2)));
+			reduced = _mm256_min_ps(reduced, _mm256_shuffle_ps(reduced, reduced, _MM_SHUFFLE(2, 3, 0, 1)));
+			closestT = _mm256_cvtss_f32(reduced);
+
+			if (closestT == FLT_MAX)
+				return false;
+
+			const int closestMask = _mm256_movemask_ps(_mm256_cmp_ps(t, reduced, _CMP_EQ_OQ));
+			closestLane = static_cast<uint32_t>(std::countr_zero(static_cast<unsigned int>(closestMask)));
+#else
+			for (uint32_t lane{ 0 }; lane < spheres.GroupLanes(group); ++lane)
+			{
+				float halfB{}, c{};
+				if (pInvariants)
+				{
+					const Vector3 toPoint{ pInvariants->toPointX[first + lane], pInvariants->toPointY[first + lane], pInvariants->toPointZ[first + lane] };
+					halfB = Vector3::Dot(ray.direction, toPoint);
+					c = pInvariants->sphereC[first + lane];
+				}
+				else
+				{
+					const Vector3 toOrigin{ ray.origin.x - spheres.x[first + lane], ray.origin.y - spheres.y[first + lane], ray.origin.z - spheres.z[first + lane] };
+					halfB = Vector3::Dot(ray.direction, toOrigin);
+					c = Vector3::Dot(toOrigin, toOrigin) - spheres.radiusSquared[first + lane];
+				}
+				const float discriminant = halfB * halfB - a * c;
+
+				if (discriminant <= 0.f)
+					continue;
+
+				const float sqrtDiscriminant = sqrtf(discriminant);
+				float t = (-halfB - sqrtDiscriminant) / a;
+				if (t < ray.min || t >= maxT)
+					t = (-halfB + sqrtDiscriminant) / a;
+
+				if (t >= ray.min && t < maxT && t < closestT)
+				{
+					closestT = t;
+					closestLane = lane;
+				}
+			}
+
+			if (closestT == FLT_MAX)
+				return false;
+#endif
+
+			const uint32_t index{ first + closestLane };
+			const Vector3 center{ spheres.x[index], spheres.y[index], spheres.z[index] };
+
+			hitRecord.t = closestT;
+			hitRecord.origin = ray.origin + ray.direction * closestT;
+			hitRecord.normal = (hitRecord.origin - center).Normalized();
+			hitRecord.didHit = true;
+			hitRecord.materialIndex = spheres.materialIndices[index];
+
+			return true;
+		}
 #pragma endregion
 #pragma region Plane HitTest
 		//PLANE HIT-TESTS
@@ -120,6 +247,21 @@ namespace dae
 			HitRecord temp{};
 			return HitTest_Plane(plane, ray, temp, true);
 		}
+
+		//distance is Dot(plane.origin - ray.origin, plane.normal), PointInvariants::planeDistances for rays that share their origin
+		inline void HitTest_Plane(const Plane& plane, float distance, const Ray& ray, HitRecord& hitRecord)
+		{
+			const float t = distance / Vector3::Dot(ray.direction, plane.normal);
+
+			if (t >= ray.min && t < ray.max && t < hitRecord.t)
+			{
+				hitRecord.t = t;
+				hitRecord.origin = ray.origin + ray.direction * t;
+				hitRecord.normal = plane.normal;
+				hitRecord.didHit = true;
+				hitRecord.materialIndex = plane.materialIndex;
+			}
+		}
 #pragma endregion
 #pragma region Triangle HitTest
 		//TRIANGLE HIT-TESTS
@@ -206,45 +348,403 @@ namespace dae
 			return tmax > 0 && tmax >= tmin;
 		}
 
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		//Returns the entry distance of the ray into the box, or FLT_MAX when the box is missed or lies beyond maxT
+		inline float SlabTest_AABB(const Vector3& minAABB, const Vector3& maxAABB, const Ray& ray, const Vector3& inverseDirection, float maxT)
 		{
-			//float closestT = hitRecord.t;
-			bool didhit = false;
-			
+			float tx1 = (minAABB.x - ray.origin.x) * inverseDirection.x;
+			float tx2 = (maxAABB.x - ray.origin.x) * inverseDirection.x;
+
+			float tmin = std::min(tx1, tx2);
+			float tmax = std::max(tx1, tx2);
+
+			float ty1 = (minAABB.y - ray.origin.y) * inverseDirection.y;
+			float ty2 = (maxAABB.y - ray.origin.y) * inverseDirection.y;
+
+			tmin = std::max(tmin, std::min(ty1, ty2));
+			tmax = std::min(tmax, std::max(ty1, ty2));
+
+			float tz1 = (minAABB.z - ray.origin.z) * inverseDirection.z;
+			float tz2 = (maxAABB.z - ray.origin.z) * inverseDirection.z;
+
+			tmin = std::max(tmin, std::min(tz1, tz2));
+			tmax = std::min(tmax, std::max(tz1, tz2));
+
+			if (tmax > 0 && tmax >= tmin && tmin < maxT)
+				return tmin;
+
+			return FLT_MAX;
+		}
+
+		//Front-to-back traversal: the nearest child is visited first, the far one waits on the stack.
+		//Nodes beyond hitRecord.t are culled, intersectLeaf(first, count) tests the primitives of a leaf and shrinks hitRecord.t
+		template<typename IntersectLeaf>
+		inline void Traverse_BVH(const BVH& bvh, const Ray& ray, const HitRecord& hitRecord, IntersectLeaf&& intersectLeaf)
+		{
+			if (bvh.IsEmpty())
+				return;
+
+			const Vector3 inverseDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+
+			if (SlabTest_AABB(bvh.nodes[0].minAABB, bvh.nodes[0].maxAABB, ray, inverseDirection, std::min(ray.max, hitRecord.t)) == FLT_MAX)
+				return;
 
-			if (!SlabTest_TriangleMesh(mesh, ray))
+			uint32_t stack[BVH::MaxDepth];
+			uint32_t stackSize{ 0 };
+			uint32_t nodeIndex{ 0 };
+
+			while (true)
 			{
-				return false;
+				const BVHNode& node = bvh.nodes[nodeIndex];
+
+				if (node.IsLeaf())
+				{
+					intersectLeaf(node.leftFirst, node.primitiveCount);
+
+					if (stackSize == 0)
+						break;
+
+					nodeIndex = stack[--stackSize];
+					continue;
+				}
+
+				uint32_t nearChild = node.leftFirst;
+				uint32_t farChild = node.leftFirst + 1;
+
+				const float maxT = std::min(ray.max, hitRecord.t);
+				float nearDistance = SlabTest_AABB(bvh.nodes[nearChild].minAABB, bvh.nodes[nearChild].maxAABB, ray, inverseDirection, maxT);
+				float farDistance = SlabTest_AABB(bvh.nodes[farChild].minAABB, bvh.nodes[farChild].maxAABB, ray, inverseDirection, maxT);
+
+				if (nearDistance > farDistance)
+				{
+					std::swap(nearDistance, farDistance);
+					std::swap(nearChild, farChild);
+				}
+
+				if (nearDistance == FLT_MAX)
+				{
+					if (stackSize == 0)
+						break;
+
+					nodeIndex = stack[--stackSize];
+				}
+				else
+				{
+					nodeIndex = nearChild;
+
+					if (farDistance != FLT_MAX)
+						stack[stackSize++] = farChild;
+				}
 			}
-			
+		}
+
+		//Tests all children of a wide node at once, returns a bitmask of the children that are hit closer than maxT
+		inline int SlabTest_WideBVHNode(const WideBVHNode& node, const Ray& ray, const Vector3& inverseDirection, float maxT, float* distances)
+		{
+#if defined(__AVX2__)
+			const __m256 originX = _mm256_set1_ps(ray.origin.x);
+			const __m256 originY = _mm256_set1_ps(ray.origin.y);
+			const __m256 originZ = _mm256_set1_ps(ray.origin.z);
+			const __m256 inverseX = _mm256_set1_ps(inverseDirection.x);
+			const __m256 inverseY = _mm256_set1_ps(inverseDirection.y);
+			const __m256 inverseZ = _mm256_set1_ps(inverseDirection.z);
+
+			const __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minX), originX), inverseX);
+			const __m256 tx2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxX), originX), inverseX);
+			const __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minY), originY), inverseY);
+			const __m256 ty2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxY), originY), inverseY);
+			const __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minZ), originZ), inverseZ);
+			const __m256 tz2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxZ), originZ), inverseZ);
+
+			const __m256 tmin = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx1, tx2), _mm256_min_ps(ty1, ty2)), _mm256_min_ps(tz1, tz2));
+			const __m256 tmax = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx1, tx2), _mm256_max_ps(ty1, ty2)), _mm256_max_ps(tz1, tz2));
+
+			__m256 hit = _mm256_cmp_ps(tmax, tmin, _CMP_GE_OQ);
+			hit = _mm256_and_ps(hit, _mm256_cmp_ps(tmax, _mm256_setzero_ps(), _CMP_GT_OQ));
+			hit = _mm256_and_ps(hit, _mm256_cmp_ps(tmin, _mm256_set1_ps(maxT), _CMP_LT_OQ));
+
+			_mm256_storeu_ps(distances, tmin);
+			return _mm256_movemask_ps(hit);
+#else
+			const __m128 originX = _mm_set1_ps(ray.origin.x);
+			const __m128 originY = _mm_set1_ps(ray.origin.y);
+			const __m128 originZ = _mm_set1_ps(ray.origin.z);
+			const __m128 inverseX = _mm_set1_ps(inverseDirection.x);
+			const __m128 inverseY = _mm_set1_ps(inverseDirection.y);
+			const __m128 inverseZ = _mm_set1_ps(inverseDirection.z);
+
+			const __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minX), originX), inverseX);
+			const __m128 tx2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxX), originX), inverseX);
+			const __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minY), originY), inverseY);
+			const __m128 ty2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxY), originY), inverseY);
+			const __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minZ), originZ), inverseZ);
+			const __m128 tz2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxZ), originZ), inverseZ);
+
+			const __m128 tmin = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)), _mm_min_ps(tz1, tz2));
+			const __m128 tmax = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)), _mm_max_ps(tz1, tz2));
+
+			__m128 hit = _mm_cmpge_ps(tmax, tmin);
+			hit = _mm_and_ps(hit, _mm_cmpgt_ps(tmax, _mm_setzero_ps()));
+			hit = _mm_and_ps(hit, _mm_cmplt_ps(tmin, _mm_set1_ps(maxT)));
+
+			_mm_storeu_ps(distances, tmin);
+			return _mm_movemask_ps(hit);
+#endif
+		}
 
-			for (size_t i = 0; i < mesh.indices.size(); i += 3)
+		//Same contract as Traverse_BVH over the collapsed wide nodes. Hit children are pushed far to near,
+		//so the nearest one is popped first, and every entry is culled again against hitRecord.t when popped
+		template<typename IntersectLeaf>
+		inline void Traverse_WideBVH(const BVH& bvh, const Ray& ray, const HitRecord& hitRecord, IntersectLeaf&& intersectLeaf)
+		{
+			if (bvh.wideNodes.empty())
+				return;
+
+			struct StackEntry
 			{
-				int index0 = mesh.indices[i];
-				int index1 = mesh.indices[i + 1];
-				int index2 = mesh.indices[i + 2];
+				uint32_t child;
+				uint32_t primitiveCount;
+				float distance;
+			};
+
+			const Vector3 inverseDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
 
-				const Vector3& v0 = mesh.transformedPositions[index0];
-				const Vector3& v1 = mesh.transformedPositions[index1];
-				const Vector3& v2 = mesh.transformedPositions[index2];
+			StackEntry stack[BVH::MaxDepth * WideBVHWidth];
+			uint32_t stackSize{ 0 };
+			stack[stackSize++] = { 0, 0, -FLT_MAX };
 
-				Triangle triangle(v0, v1, v2, mesh.transformedNormals[index0]);
-				// it doesnt use this mesh.cullMode;
-				triangle.cullMode = mesh.cullMode;
+			while (stackSize > 0)
+			{
+				const StackEntry entry = stack[--stackSize];
 
-				if (HitTest_Triangle(triangle, ray, hitRecord))
+				if (entry.distance >= std::min(ray.max, hitRecord.t))
+					continue;
+
+				if (entry.primitiveCount > 0)
 				{
-					
-					hitRecord.didHit = true;
-					hitRecord.materialIndex = mesh.materialIndex;
+					intersectLeaf(entry.child, entry.primitiveCount);
+					continue;
+				}
+
+				const WideBVHNode& node = bvh.wideNodes[entry.child];
+
+				float distances[WideBVHWidth];
+				int hitMask = SlabTest_WideBVHNode(node, ray, inverseDirection, std::min(ray.max, hitRecord.t), distances);
+
+				//Insertion sort of the hit children, farthest first
+				StackEntry hits[WideBVHWidth];
+				uint32_t hitCount{ 0 };
+
+				while (hitMask != 0)
+				{
+					const uint32_t slot = static_cast<uint32_t>(std::countr_zero(static_cast<unsigned int>(hitMask)));
+					hitMask &= hitMask - 1;
+
+					const StackEntry hit{ node.children[slot], node.primitiveCounts[slot], distances[slot] };
+
+					uint32_t i{ hitCount++ };
+					while (i > 0 && hits[i - 1].distance < hit.distance)
+					{
+						hits[i] = hits[i - 1];
+						--i;
+					}
+					hits[i] = hit;
+				}
+
+				for (uint32_t i{ 0 }; i < hitCount; ++i)
+				{
+					stack[stackSize++] = hits[i];
+				}
+			}
+		}
+
+		//Slab test on plain float bounds, the quantized traversal decodes straight into these
+		inline float SlabTest_Bounds(const float minBounds[3], const float maxBounds[3], const Ray& ray, const Vector3& inverseDirection, float maxT)
+		{
+			const float tx1 = (minBounds[0] - ray.origin.x) * inverseDirection.x;
+			const float tx2 = (maxBounds[0] - ray.origin.x) * inverseDirection.x;
+			const float ty1 = (minBounds[1] - ray.origin.y) * inverseDirection.y;
+			const float ty2 = (maxBounds[1] - ray.origin.y) * inverseDirection.y;
+			const float tz1 = (minBounds[2] - ray.origin.z) * inverseDirection.z;
+			const float tz2 = (maxBounds[2] - ray.origin.z) * inverseDirection.z;
+
+			const float tmin = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::min(tz1, tz2));
+			const float tmax = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::max(tz1, tz2));
+
+			if (tmax > 0 && tmax >= tmin && tmin < maxT)
+				return tmin;
+
+			return FLT_MAX;
+		}
+
+		//Same contract as Traverse_BVH over the quantized nodes. A node only knows its children relative to its own box,
+		//so every stack entry carries the decoded box of the node it points to
+		template<typename IntersectLeaf>
+		inline void Traverse_QuantizedBVH(const BVH& bvh, const Ray& ray, const HitRecord& hitRecord, IntersectLeaf&& intersectLeaf)
+		{
+			if (bvh.quantizedNodes.empty())
+				return;
+
+			struct StackEntry
+			{
+				uint32_t nodeIndex;
+				float distance;
+				float minBounds[3];
+				float maxBounds[3];
+			};
+
+			const Vector3 inverseDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+
+			StackEntry stack[BVH::MaxDepth];
+			uint32_t stackSize{ 0 };
+
+			StackEntry& root = stack[stackSize++];
+			root.nodeIndex = 0;
+			root.minBounds[0] = bvh.quantizedBounds.min.x;
+			root.minBounds[1] = bvh.quantizedBounds.min.y;
+			root.minBounds[2] = bvh.quantizedBounds.min.z;
+			root.maxBounds[0] = bvh.quantizedBounds.max.x;
+			root.maxBounds[1] = bvh.quantizedBounds.max.y;
+			root.maxBounds[2] = bvh.quantizedBounds.max.z;
+			root.distance = SlabTest_Bounds(root.minBounds, root.maxBounds, ray, inverseDirection, std::min(ray.max, hitRecord.t));
+
+			while (stackSize > 0)
+			{
+				const StackEntry entry = stack[--stackSize];
+
+				if (entry.distance >= std::min(ray.max, hitRecord.t))
+					continue;
+
+				const QuantizedBVHNode& node = bvh.quantizedNodes[entry.nodeIndex];
+
+				StackEntry children[2];
+				for (uint32_t child{ 0 }; child < 2; ++child)
+				{
+					children[child].nodeIndex = node.children[child];
+					children[child].distance = FLT_MAX;
+
+					if (node.IsEmpty(child))
+						continue;
+
+					node.DecodeChild(entry.minBounds, entry.maxBounds, child, children[child].minBounds, children[child].maxBounds);
+					children[child].distance = SlabTest_Bounds(children[child].minBounds, children[child].maxBounds, ray, inverseDirection, std::min(ray.max, hitRecord.t));
+				}
+
+				const uint32_t nearChild{ children[1].distance < children[0].distance ? 1u : 0u };
+				const uint32_t farChild{ 1u - nearChild };
+
+				//Leaves are tested right away, near first, inner children go on the stack far first
+				if (node.primitiveCounts[nearChild] > 0 && children[nearChild].distance < hitRecord.t)
+					intersectLeaf(node.children[nearChild], node.primitiveCounts[nearChild]);
+
+				if (node.primitiveCounts[farChild] > 0 && children[farChild].distance < hitRecord.t)
+					intersectLeaf(node.children[farChild], node.primitiveCounts[farChild]);
+
+				if (node.primitiveCounts[farChild] == 0 && children[farChild].distance != FLT_MAX)
+					stack[stackSize++] = children[farChild];
+
+				if (node.primitiveCounts[nearChild] == 0 && children[nearChild].distance != FLT_MAX)
+					stack[stackSize++] = children[nearChild];
+			}
+		}
+
+		//Moeller-Trumbore over a precomputed record, only t is written to the hit record.
+		//det = -Dot(faceNormal, ray.direction), so the culling matches HitTest_Triangle
+		inline bool HitTest_TriangleRecord(const TriangleRecords& triangles, size_t index, TriangleCullMode cullMode, const Ray& ray, HitRecord& hitRecord)
+		{
+			const Vector3 edge1{ triangles.edge1x[index], triangles.edge1y[index], triangles.edge1z[index] };
+			const Vector3 edge2{ triangles.edge2x[index], triangles.edge2y[index], triangles.edge2z[index] };
+
+			const Vector3 p = Vector3::Cross(ray.direction, edge2);
+			const float det = Vector3::Dot(edge1, p);
+
+			if (cullMode == TriangleCullMode::BackFaceCulling && det < 0.f)
+				return false;
+
+			if (cullMode == TriangleCullMode::FrontFaceCulling && det > 0.f)
+				return false;
+
+			//det scales with the triangle area, only a ray exactly in the plane is rejected up front,
+			//nearly parallel ones get a huge inverseDet and fail the u and v tests
+			if (det == 0.f)
+				return false;
+
+			const float inverseDet = 1.f / det;
+			const Vector3 toOrigin{ ray.origin.x - triangles.v0x[index], ray.origin.y - triangles.v0y[index], ray.origin.z - triangles.v0z[index] };
+
+			const float u = Vector3::Dot(toOrigin, p) * inverseDet;
+			if (u < 0.f || u > 1.f)
+				return false;
+
+			const Vector3 q = Vector3::Cross(toOrigin, edge1);
+			const float v = Vector3::Dot(ray.direction, q) * inverseDet;
+			if (v < 0.f || u + v > 1.f)
+				return false;
+
+			const float t = Vector3::Dot(edge2, q) * inverseDet;
+			if (t >= ray.min && t < ray.max && t < hitRecord.t)
+			{
+				hitRecord.t = t;
+				return true;
+			}
+
+			return false;
+		}
+
+		//Tests the triangles [first, first + count) of the mesh BVH against a ray that is already in object space.
+		//hitTriangle receives the record index of the closest hit, the normal is only decoded for that one
+		inline bool HitTest_TriangleMeshLeaf(const TriangleMesh& mesh, const Ray& objectRay, HitRecord& hitRecord, uint32_t first, uint32_t count, uint32_t& hitTriangle)
+		{
+			bool didhit = false;
+
+			for (uint32_t i = first; i < first + count; ++i)
+			{
+				if (HitTest_TriangleRecord(mesh.triangleRecords, i, mesh.cullMode, objectRay, hitRecord))
+				{
+					hitTriangle = i;
 					didhit = true;
-					//return true;
 				}
 			}
 
 			return didhit;
-			//return false;
-			
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			bool didhit = false;
+
+			//The direction is not renormalized, so t in object space is the same t as in world space
+			Ray objectRay{};
+			objectRay.origin = mesh.inverseTransform.TransformPoint(ray.origin);
+			objectRay.direction = mesh.inverseTransform.TransformVector(ray.direction);
+			objectRay.min = ray.min;
+			objectRay.max = ray.max;
+
+			uint32_t hitTriangle{};
+			const auto intersectLeaf = [&](uint32_t first, uint32_t count)
+				{
+					if (HitTest_TriangleMeshLeaf(mesh, objectRay, hitRecord, first, count, hitTriangle))
+						didhit = true;
+				};
+
+#if defined(QUANTIZED_BVH)
+			Traverse_QuantizedBVH(mesh.bvh, objectRay, hitRecord, intersectLeaf);
+#elif defined(WIDE_BVH)
+			Traverse_WideBVH(mesh.bvh, objectRay, hitRecord, intersectLeaf);
+#else
+			Traverse_BVH(mesh.bvh, objectRay, hitRecord, intersectLeaf);
+#endif
+
+			//Only the closest hit is moved back to world space
+			if (didhit)
+			{
+				hitRecord.origin = ray.origin + ray.direction * hitRecord.t;
+				const Vector3 normal = TriangleRecords::UnpackNormal(mesh.triangleRecords.packedNormals[hitTriangle]);
+				hitRecord.normal = mesh.rotationTransform.TransformVector(normal).Normalized();
+				hitRecord.didHit = true;
+				hitRecord.materialIndex = mesh.materialIndex;
+			}
+
+			return didhit;
 		}
 
 		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
@@ -254,6 +754,547 @@ namespace dae
 		}
 
 		
+#pragma endregion
+#pragma region Occlusion
+		//OCCLUSION TESTS
+		//Any-hit queries for shadow rays: true as soon as something lies in [ray.min, ray.max), nothing else is computed.
+		//Callers bound ray.max by the light distance so occluders behind the light are ignored and traversal culls early
+		inline bool OcclusionTest_Sphere(const Sphere& sphere, const Ray& ray)
+		{
+			const Vector3 toOrigin = ray.origin - sphere.origin;
+			const float a = Vector3::Dot(ray.direction, ray.direction);
+			const float halfB = Vector3::Dot(ray.direction, toOrigin);
+			const float c = Vector3::Dot(toOrigin, toOrigin) - sphere.radius * sphere.radius;
+
+			const float discriminant = halfB * halfB - a * c;
+			if (discriminant <= 0.f)
+				return false;
+
+			const float sqrtDiscriminant = sqrtf(discriminant);
+			const float t1 = (-halfB - sqrtDiscriminant) / a;
+			const float t2 = (-halfB + sqrtDiscriminant) / a;
+
+			return (t1 >= ray.min && t1 < ray.max) || (t2 >= ray.min && t2 < ray.max);
+		}
+
+		inline bool OcclusionTest_SphereGroup(const SpherePool& spheres, uint32_t group, const Ray& ray, const PointInvariants* pInvariants = nullptr)
+		{
+			HitRecord temp{};
+			return HitTest_SphereGroup(spheres, group, ray, temp, pInvariants);
+		}
+
+		inline bool OcclusionTest_Plane(const Plane& plane, const Ray& ray)
+		{
+			const float t = Vector3::Dot(plane.origin - ray.origin, plane.normal) / Vector3::Dot(ray.direction, plane.normal);
+			return t >= ray.min && t < ray.max;
+		}
+
+		inline bool OcclusionTest_Plane(const Plane& plane, float distance, const Ray& ray)
+		{
+			const float t = distance / Vector3::Dot(ray.direction, plane.normal);
+			return t >= ray.min && t < ray.max;
+		}
+
+		//Any-hit Moeller-Trumbore for a loose triangle: no normalize and no hit record, only t is checked against [ray.min, ray.max).
+		//Culls on the stored normal like HitTest_Triangle
+		inline bool OcclusionTest_Triangle(const Triangle& triangle, const Ray& ray)
+		{
+			const float normalDotDirection = Vector3::Dot(triangle.normal, ray.direction);
+			if (triangle.cullMode == TriangleCullMode::FrontFaceCulling && normalDotDirection < 0.f)
+				return false;
+
+			if (triangle.cullMode == TriangleCullMode::BackFaceCulling && normalDotDirection > 0.f)
+				return false;
+
+			const Vector3 edge1 = triangle.v1 - triangle.v0;
+			const Vector3 edge2 = triangle.v2 - triangle.v0;
+
+			const Vector3 p = Vector3::Cross(ray.direction, edge2);
+			const float det = Vector3::Dot(edge1, p);
+			if (det == 0.f)
+				return false;
+
+			const float inverseDet = 1.f / det;
+			const Vector3 toOrigin = ray.origin - triangle.v0;
+
+			const float u = Vector3::Dot(toOrigin, p) * inverseDet;
+			if (u < 0.f || u > 1.f)
+				return false;
+
+			const Vector3 q = Vector3::Cross(toOrigin, edge1);
+			const float v = Vector3::Dot(ray.direction, q) * inverseDet;
+			if (v < 0.f || u + v > 1.f)
+				return false;
+
+			const float t = Vector3::Dot(edge2, q) * inverseDet;
+			return t >= ray.min && t < ray.max;
+		}
+
+		inline bool OcclusionTest_TriangleRecord(const TriangleRecords& triangles, size_t index, TriangleCullMode cullMode, const Ray& ray)
+		{
+			HitRecord temp{};
+			return HitTest_TriangleRecord(triangles, index, cullMode, ray, temp);
+		}
+
+		//Any-hit traversal: no near/far ordering since any occluder ends the query, children are taken in memory order.
+		//intersectLeaf(first, count) returns true when a primitive of the leaf blocks the ray
+		template<typename IntersectLeaf>
+		inline bool TraverseAnyHit_BVH(const BVH& bvh, const Ray& ray, IntersectLeaf&& intersectLeaf)
+		{
+			if (bvh.IsEmpty())
+				return false;
+
+			const Vector3 inverseDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+
+			if (SlabTest_AABB(bvh.nodes[0].minAABB, bvh.nodes[0].maxAABB, ray, inverseDirection, ray.max) == FLT_MAX)
+				return false;
+
+			uint32_t stack[BVH::MaxDepth];
+			uint32_t stackSize{ 0 };
+			stack[stackSize++] = 0;
+
+			while (stackSize > 0)
+			{
+				const BVHNode& node = bvh.nodes[stack[--stackSize]];
+
+				if (node.IsLeaf())
+				{
+					if (intersectLeaf(node.leftFirst, node.primitiveCount))
+						return true;
+
+					continue;
+				}
+
+				const uint32_t leftChild = node.leftFirst;
+				const uint32_t rightChild = node.leftFirst + 1;
+
+				if (SlabTest_AABB(bvh.nodes[rightChild].minAABB, bvh.nodes[rightChild].maxAABB, ray, inverseDirection, ray.max) != FLT_MAX)
+					stack[stackSize++] = rightChild;
+
+				if (SlabTest_AABB(bvh.nodes[leftChild].minAABB, bvh.nodes[leftChild].maxAABB, ray, inverseDirection, ray.max) != FLT_MAX)
+					stack[stackSize++] = leftChild;
+			}
+
+			return false;
+		}
+
+		template<typename IntersectLeaf>
+		inline bool TraverseAnyHit_WideBVH(const BVH& bvh, const Ray& ray, IntersectLeaf&& intersectLeaf)
+		{
+			if (bvh.wideNodes.empty())
+				return false;
+
+			const Vector3 inverseDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+
+			uint32_t stack[BVH::MaxDepth * WideBVHWidth];
+			uint32_t stackSize{ 0 };
+			stack[stackSize++] = 0;
+
+			while (stackSize > 0)
+			{
+				const WideBVHNode& node = bvh.wideNodes[stack[--stackSize]];
+
+				float distances[WideBVHWidth];
+				int hitMask = SlabTest_WideBVHNode(node, ray, inverseDirection, ray.max, distances);
+
+				//Leaves are tested right away, inner children wait on the stack
+				while (hitMask != 0)
+				{
+					const uint32_t slot = static_cast<uint32_t>(std::countr_zero(static_cast<unsigned int>(hitMask)));
+					hitMask &= hitMask - 1;
+
+					if (node.primitiveCounts[slot] == 0)
+						stack[stackSize++] = node.children[slot];
+					else if (intersectLeaf(node.children[slot], node.primitiveCounts[slot]))
+						return true;
+				}
+			}
+
+			return false;
+		}
+
+		inline bool OcclusionTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+		{
+			Ray objectRay{};
+			objectRay.origin = mesh.inverseTransform.TransformPoint(ray.origin);
+			objectRay.direction = mesh.inverseTransform.TransformVector(ray.direction);
+			objectRay.min = ray.min;
+			objectRay.max = ray.max;
+
+			const auto intersectLeaf = [&](uint32_t first, uint32_t count)
+				{
+					for (uint32_t i = first; i < first + count; ++i)
+					{
+						if (OcclusionTest_TriangleRecord(mesh.triangleRecords, i, mesh.cullMode, objectRay))
+							return true;
+					}
+					return false;
+				};
+
+#if defined(WIDE_BVH)
+			return TraverseAnyHit_WideBVH(mesh.bvh, objectRay, intersectLeaf);
+#else
+			return TraverseAnyHit_BVH(mesh.bvh, objectRay, intersectLeaf);
+#endif
+		}
+#pragma endregion
+#pragma region Packet HitTest
+		//PACKET HIT-TESTS
+		//Closest hit queries for a coherent RayPacket. Every kernel takes the mask of lanes to test, fills the hit records
+		//of those lanes exactly like its single ray counterpart and keeps packet.t in sync with them.
+		//Below this many active rays a packet is not worth its setup anymore and the rays go through the single ray path
+		constexpr uint32_t PacketFallbackRays{ 2 };
+
+		//Runs hitTest(ray, lane) for every lane in mask and copies the new closest t back into the packet
+		template<typename HitTest>
+		inline void ForEachLane(RayPacket& packet, uint32_t mask, HitRecord* pHitRecords, HitTest&& hitTest)
+		{
+			while (mask != 0)
+			{
+				const uint32_t lane = static_cast<uint32_t>(std::countr_zero(mask));
+				mask &= mask - 1;
+
+				hitTest(packet.GetRay(lane), pHitRecords[lane]);
+				packet.t[lane] = pHitRecords[lane].t;
+			}
+		}
+
+		//The origin is shared, so only the denominator differs per lane. distance is Dot(plane.origin - packet.origin, plane.normal)
+		inline void HitTest_Plane(const Plane& plane, float distance, RayPacket& packet, uint32_t mask, HitRecord* pHitRecords)
+		{
+			const float a = distance;
+
+			while (mask != 0)
+			{
+				const uint32_t lane = static_cast<uint32_t>(std::countr_zero(mask));
+				mask &= mask - 1;
+
+				const Vector3 direction{ packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane] };
+				const float t = a / Vector3::Dot(direction, plane.normal);
+
+				if (t >= packet.min && t < packet.max && t < packet.t[lane])
+				{
+					HitRecord& hitRecord = pHitRecords[lane];
+					hitRecord.t = t;
+					hitRecord.origin = packet.origin + direction * t;
+					hitRecord.normal = plane.normal;
+					hitRecord.didHit = true;
+					hitRecord.materialIndex = plane.materialIndex;
+					packet.t[lane] = t;
+				}
+			}
+		}
+
+		inline void HitTest_Plane(const Plane& plane, RayPacket& packet, uint32_t mask, HitRecord* pHitRecords)
+		{
+			HitTest_Plane(plane, Vector3::Dot(plane.origin - packet.origin, plane.normal), packet, mask, pHitRecords);
+		}
+
+		//Two stage box test. The interval test bounds the entry and exit distances of every ray at once from the
+		//inverse direction ranges, a box the whole packet misses costs one scalar test. The lanes of a box that
+		//survives it are tested exactly, with the same arithmetic as SlabTest_AABB.
+		//Returns the lanes of mask that hit the box closer than their t, distances receives the entry distance per lane
+		inline uint32_t SlabTest_Packet(const Vector3& minAABB, const Vector3& maxAABB, const RayPacket& packet, uint32_t mask, float* distances)
+		{
+			float entry{ -FLT_MAX };
+			float exit{ FLT_MAX };
+			for (int axis{ 0 }; axis < 3; ++axis)
+			{
+				const bool positive = packet.inverseMin[axis] > 0.f;
+				const float toNear = (positive ? minAABB[axis] : maxAABB[axis]) - packet.origin[axis];
+				const float toFar = (positive ? maxAABB[axis] : minAABB[axis]) - packet.origin[axis];
+
+				entry = std::max(entry, std::min(toNear * packet.inverseMin[axis], toNear * packet.inverseMax[axis]));
+				exit = std::min(exit, std::max(toFar * packet.inverseMin[axis], toFar * packet.inverseMax[axis]));
+			}
+
+			if (entry > exit || exit <= 0.f || entry >= packet.max)
+				return 0;
+
+			uint32_t hitMask{ 0 };
+
+#if defined(__AVX2__)
+			const __m256 toMinX = _mm256_set1_ps(minAABB.x - packet.origin.x);
+			const __m256 toMinY = _mm256_set1_ps(minAABB.y - packet.origin.y);
+			const __m256 toMinZ = _mm256_set1_ps(minAABB.z - packet.origin.z);
+			const __m256 toMaxX = _mm256_set1_ps(maxAABB.x - packet.origin.x);
+			const __m256 toMaxY = _mm256_set1_ps(maxAABB.y - packet.origin.y);
+			const __m256 toMaxZ = _mm256_set1_ps(maxAABB.z - packet.origin.z);
+			const __m256 maxT = _mm256_set1_ps(packet.max);
+
+			for (uint32_t first{ 0 }; first < RayPacket::Size; first += 8)
+			{
+				const uint32_t chunkMask{ (mask >> first) & 0xFF };
+				if (chunkMask == 0)
+					continue;
+
+				const __m256 inverseX = _mm256_load_ps(&packet.inverseX[first]);
+				const __m256 inverseY = _mm256_load_ps(&packet.inverseY[first]);
+				const __m256 inverseZ = _mm256_load_ps(&packet.inverseZ[first]);
+
+				const __m256 tx1 = _mm256_mul_ps(toMinX, inverseX);
+				const __m256 tx2 = _mm256_mul_ps(toMaxX, inverseX);
+				const __m256 ty1 = _mm256_mul_ps(toMinY, inverseY);
+				const __m256 ty2 = _mm256_mul_ps(toMaxY, inverseY);
+				const __m256 tz1 = _mm256_mul_ps(toMinZ, inverseZ);
+				const __m256 tz2 = _mm256_mul_ps(toMaxZ, inverseZ);
+
+				const __m256 tmin = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx1, tx2), _mm256_min_ps(ty1, ty2)), _mm256_min_ps(tz1, tz2));
+				const __m256 tmax = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx1, tx2), _mm256_max_ps(ty1, ty2)), _mm256_max_ps(tz1, tz2));
+
+				__m256 hit = _mm256_cmp_ps(tmax, tmin, _CMP_GE_OQ);
+				hit = _mm256_and_ps(hit, _mm256_cmp_ps(tmax, _mm256_setzero_ps(), _CMP_GT_OQ));
+				hit = _mm256_and_ps(hit, _mm256_cmp_ps(tmin, _mm256_load_ps(&packet.t[first]), _CMP_LT_OQ));
+				hit = _mm256_and_ps(hit, _mm256_cmp_ps(tmin, maxT, _CMP_LT_OQ));
+
+				_mm256_store_ps(&distances[first], tmin);
+				hitMask |= (static_cast<uint32_t>(_mm256_movemask_ps(hit)) & chunkMask) << first;
+			}
+#else
+			while (mask != 0)
+			{
+				const uint32_t lane = static_cast<uint32_t>(std::countr_zero(mask));
+				mask &= mask - 1;
+
+				const Vector3 inverseDirection{ packet.inverseX[lane], packet.inverseY[lane], packet.inverseZ[lane] };
+				distances[lane] = SlabTest_AABB(minAABB, maxAABB, packet.GetRay(lane), inverseDirection, std::min(packet.max, packet.t[lane]));
+				if (distances[lane] != FLT_MAX)
+					hitMask |= 1u << lane;
+			}
+#endif
+
+			return hitMask;
+		}
+
+		//Front-to-back traversal of the binary nodes with a lane mask per stack entry. A child is entered with the lanes that hit it,
+		//so rays drop out of the packet where they leave the subtree, and children are ordered by the first of those lanes.
+		//intersectLeaf(first, count, mask) tests the primitives of a leaf for the lanes in mask and shrinks packet.t
+		template<typename IntersectLeaf>
+		inline void Traverse_BVH(const BVH& bvh, const RayPacket& packet, uint32_t mask, IntersectLeaf&& intersectLeaf)
+		{
+			if (bvh.IsEmpty())
+				return;
+
+			struct StackEntry
+			{
+				uint32_t nodeIndex;
+				uint32_t mask;
+			};
+
+			alignas(32) float distances[RayPacket::Size];
+
+			uint32_t nodeMask = SlabTest_Packet(bvh.nodes[0].minAABB, bvh.nodes[0].maxAABB, packet, mask, distances);
+			if (nodeMask == 0)
+				return;
+
+			StackEntry stack[BVH::MaxDepth];
+			uint32_t stackSize{ 0 };
+			uint32_t nodeIndex{ 0 };
+
+			while (true)
+			{
+				const BVHNode& node = bvh.nodes[nodeIndex];
+
+				if (node.IsLeaf())
+				{
+					intersectLeaf(node.leftFirst, node.primitiveCount, nodeMask);
+				}
+				else
+				{
+					uint32_t nearChild = node.leftFirst;
+					uint32_t farChild = node.leftFirst + 1;
+
+					uint32_t nearMask = SlabTest_Packet(bvh.nodes[nearChild].minAABB, bvh.nodes[nearChild].maxAABB, packet, nodeMask, distances);
+					float nearDistance = nearMask ? distances[std::countr_zero(nearMask)] : FLT_MAX;
+					uint32_t farMask = SlabTest_Packet(bvh.nodes[farChild].minAABB, bvh.nodes[farChild].maxAABB, packet, nodeMask, distances);
+					float farDistance = farMask ? distances[std::countr_zero(farMask)] : FLT_MAX;
+
+					if (nearDistance > farDistance)
+					{
+						std::swap(nearDistance, farDistance);
+						std::swap(nearChild, farChild);
+						std::swap(nearMask, farMask);
+					}
+
+					if (nearMask != 0)
+					{
+						if (farMask != 0)
+							stack[stackSize++] = { farChild, farMask };
+
+						nodeIndex = nearChild;
+						nodeMask = nearMask;
+						continue;
+					}
+				}
+
+				if (stackSize == 0)
+					break;
+
+				nodeIndex = stack[--stackSize].nodeIndex;
+				nodeMask = stack[stackSize].mask;
+			}
+		}
+
+		//HitTest_TriangleRecord for the lanes in mask. The origin is shared, so toOrigin and q are the same for every lane
+		//and only p, det, u and v are computed per lane. hitTriangles receives index for every lane that got closer
+		inline uint32_t HitTest_TriangleRecord(const TriangleRecords& triangles, size_t index, TriangleCullMode cullMode, RayPacket& packet, uint32_t mask, uint32_t* hitTriangles)
+		{
+			uint32_t hitMask{ 0 };
+
+#if defined(__AVX2__)
+			const Vector3 edge1{ triangles.edge1x[index], triangles.edge1y[index], triangles.edge1z[index] };
+			const Vector3 edge2{ triangles.edge2x[index], triangles.edge2y[index], triangles.edge2z[index] };
+			const Vector3 toOrigin{ packet.origin.x - triangles.v0x[index], packet.origin.y - triangles.v0y[index], packet.origin.z - triangles.v0z[index] };
+			const Vector3 q = Vector3::Cross(toOrigin, edge1);
+
+			const __m256 edge1X = _mm256_set1_ps(edge1.x);
+			const __m256 edge1Y = _mm256_set1_ps(edge1.y);
+			const __m256 edge1Z = _mm256_set1_ps(edge1.z);
+			const __m256 edge2X = _mm256_set1_ps(edge2.x);
+			const __m256 edge2Y = _mm256_set1_ps(edge2.y);
+			const __m256 edge2Z = _mm256_set1_ps(edge2.z);
+			const __m256 toOriginX = _mm256_set1_ps(toOrigin.x);
+			const __m256 toOriginY = _mm256_set1_ps(toOrigin.y);
+			const __m256 toOriginZ = _mm256_set1_ps(toOrigin.z);
+			const __m256 qX = _mm256_set1_ps(q.x);
+			const __m256 qY = _mm256_set1_ps(q.y);
+			const __m256 qZ = _mm256_set1_ps(q.z);
+			const __m256 tNumerator = _mm256_set1_ps(Vector3::Dot(edge2, q));
+
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 one = _mm256_set1_ps(1.f);
+			for (uint32_t first{ 0 }; first < RayPacket::Size; first += 8)
+			{
+				const uint32_t chunkMask{ (mask >> first) & 0xFF };
+				if (chunkMask == 0)
+					continue;
+
+				const __m256 directionX = _mm256_load_ps(&packet.directionX[first]);
+				const __m256 directionY = _mm256_load_ps(&packet.directionY[first]);
+				const __m256 directionZ = _mm256_load_ps(&packet.directionZ[first]);
+
+				const __m256 pX = _mm256_sub_ps(_mm256_mul_ps(directionY, edge2Z), _mm256_mul_ps(directionZ, edge2Y));
+				const __m256 pY = _mm256_sub_ps(_mm256_mul_ps(directionZ, edge2X), _mm256_mul_ps(directionX, edge2Z));
+				const __m256 pZ = _mm256_sub_ps(_mm256_mul_ps(directionX, edge2Y), _mm256_mul_ps(directionY, edge2X));
+				const __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge1X, pX), _mm256_mul_ps(edge1Y, pY)), _mm256_mul_ps(edge1Z, pZ));
+
+				//Written as negated rejections so a lane is kept exactly when the single ray kernel keeps it
+				__m256 valid = _mm256_cmp_ps(det, zero, _CMP_NEQ_UQ);
+				if (cullMode == TriangleCullMode::BackFaceCulling)
+					valid = _mm256_and_ps(valid, _mm256_cmp_ps(det, zero, _CMP_NLT_UQ));
+				if (cullMode == TriangleCullMode::FrontFaceCulling)
+					valid = _mm256_and_ps(valid, _mm256_cmp_ps(det, zero, _CMP_NGT_UQ));
+
+				const __m256 inverseDet = _mm256_div_ps(one, det);
+
+				const __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toOriginX, pX), _mm256_mul_ps(toOriginY, pY)), _mm256_mul_ps(toOriginZ, pZ)), inverseDet);
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_NLT_UQ), _mm256_cmp_ps(u, one, _CMP_NGT_UQ)));
+
+				const __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(directionX, qX), _mm256_mul_ps(directionY, qY)), _mm256_mul_ps(directionZ, qZ)), inverseDet);
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_NLT_UQ), _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_NGT_UQ)));
+
+				const __m256 t = _mm256_mul_ps(tNumerator, inverseDet);
+				const __m256 closestT = _mm256_load_ps(&packet.t[first]);
+				valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(packet.min), _CMP_GE_OQ));
+				valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(packet.max), _CMP_LT_OQ));
+				valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, closestT, _CMP_LT_OQ));
+
+				const uint32_t chunkHits{ static_cast<uint32_t>(_mm256_movemask_ps(valid)) & chunkMask };
+				if (chunkHits == 0)
+					continue;
+
+				_mm256_store_ps(&packet.t[first], _mm256_blendv_ps(closestT, t, valid));
+				hitMask |= chunkHits << first;
+			}
+
+			for (uint32_t lanes{ hitMask }; lanes != 0; lanes &= lanes - 1)
+			{
+				hitTriangles[std::countr_zero(lanes)] = static_cast<uint32_t>(index);
+			}
+#else
+			while (mask != 0)
+			{
+				const uint32_t lane = static_cast<uint32_t>(std::countr_zero(mask));
+				mask &= mask - 1;
+
+				HitRecord hitRecord{};
+				hitRecord.t = packet.t[lane];
+				if (HitTest_TriangleRecord(triangles, index, cullMode, packet.GetRay(lane), hitRecord))
+				{
+					packet.t[lane] = hitRecord.t;
+					hitTriangles[lane] = static_cast<uint32_t>(index);
+					hitMask |= 1u << lane;
+				}
+			}
+#endif
+
+			return hitMask;
+		}
+
+		//Moves the packet into object space and traverses the mesh BVH with it. The binary nodes are used, a wide node
+		//would need a lane mask per child. Packets that thinned out or lost coherence in object space fall back to single rays
+		inline void HitTest_TriangleMesh(const TriangleMesh& mesh, RayPacket& packet, uint32_t mask, HitRecord* pHitRecords)
+		{
+			const auto traceSingleRays = [&]()
+				{
+					ForEachLane(packet, mask, pHitRecords, [&](const Ray& ray, HitRecord& hitRecord) { HitTest_TriangleMesh(mesh, ray, hitRecord); });
+				};
+
+			if (static_cast<uint32_t>(std::popcount(mask)) <= PacketFallbackRays)
+			{
+				traceSingleRays();
+				return;
+			}
+
+			RayPacket objectPacket{};
+			objectPacket.origin = mesh.inverseTransform.TransformPoint(packet.origin);
+			objectPacket.min = packet.min;
+			objectPacket.max = packet.max;
+
+			for (uint32_t lanes{ mask }; lanes != 0; lanes &= lanes - 1)
+			{
+				const uint32_t lane = static_cast<uint32_t>(std::countr_zero(lanes));
+				objectPacket.SetRay(lane, mesh.inverseTransform.TransformVector({ packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane] }));
+			}
+
+			objectPacket.Prepare();
+			if (!objectPacket.isCoherent)
+			{
+				traceSingleRays();
+				return;
+			}
+
+			std::copy(std::begin(packet.t), std::end(packet.t), std::begin(objectPacket.t));
+
+			uint32_t hitTriangles[RayPacket::Size];
+			uint32_t hitMask{ 0 };
+
+			Traverse_BVH(mesh.bvh, objectPacket, mask, [&](uint32_t first, uint32_t count, uint32_t leafMask)
+				{
+					for (uint32_t i = first; i < first + count; ++i)
+					{
+						hitMask |= HitTest_TriangleRecord(mesh.triangleRecords, i, mesh.cullMode, objectPacket, leafMask, hitTriangles);
+					}
+				});
+
+			//Only the closest hit of every lane is moved back to world space
+			while (hitMask != 0)
+			{
+				const uint32_t lane = static_cast<uint32_t>(std::countr_zero(hitMask));
+				hitMask &= hitMask - 1;
+
+				const Vector3 direction{ packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane] };
+				const Vector3 normal = TriangleRecords::UnpackNormal(mesh.triangleRecords.packedNormals[hitTriangles[lane]]);
+
+				HitRecord& hitRecord = pHitRecords[lane];
+				hitRecord.t = objectPacket.t[lane];
+				hitRecord.origin = packet.origin + direction * hitRecord.t;
+				hitRecord.normal = mesh.rotationTransform.TransformVector(normal).Normalized();
+				hitRecord.didHit = true;
+				hitRecord.materialIndex = mesh.materialIndex;
+				packet.t[lane] = hitRecord.t;
+			}
+		}
 #pragma endregion
 	}
 
@@ -1,8 +1,14 @@
 #pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 
 namespace dae
 {
 	struct Vector4;
+
+	//Everything the intersection loops touch is defined in the class so it always inlines,
+	//only the conversions to Vector4 and the constants live in Vector3.cpp
 	struct Vector3
 	{
 		float x{};
@@ -10,24 +16,73 @@ namespace dae
 		float z{};
 
 		Vector3() = default;
-		Vector3(float _x, float _y, float _z);
-		Vector3(const Vector3& from, const Vector3& to);
+		Vector3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+		Vector3(const Vector3& from, const Vector3& to) : x(to.x - from.x), y(to.y - from.y), z(to.z - from.z) {}
 		Vector3(const Vector4& v);
 
-		float Magnitude() const;
-		float SqrMagnitude() const;
-		float Normalize();
-		Vector3 Normalized() const;
+		float Magnitude() const
+		{
+			return sqrtf(x * x + y * y + z * z);
+		}
+
+		float SqrMagnitude() const
+		{
+			return x * x + y * y + z * z;
+		}
+
+		float Normalize()
+		{
+			const float m = Magnitude();
+			x /= m;
+			y /= m;
+			z /= m;
+
+			return m;
+		}
+
+		Vector3 Normalized() const
+		{
+			const float m = Magnitude();
+			return { x / m, y / m, z / m };
+		}
 
-		static float Dot(const Vector3& v1, const Vector3& v2);
-		static Vector3 Cross(const Vector3& v1, const Vector3& v2);
-		static Vector3 Project(const Vector3& v1, const Vector3& v2);
-		static Vector3 Reject(const Vector3& v1, const Vector3& v2);
-		static Vector3 Reflect(const Vector3& v1, const Vector3& v2);
+		static float Dot(const Vector3& v1, const Vector3& v2)
+		{
+			return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+		}
 
+		static Vector3 Cross(const Vector3& v1, const Vector3& v2)
+		{
+			return {
+				(v1.y * v2.z) - (v1.z * v2.y),
+				(v1.z * v2.x) - (v1.x * v2.z),
+				(v1.x * v2.y) - (v1.y * v2.x) };
+		}
 
-		static Vector3 Max(const Vector3& v1, const Vector3& v2);
-		static Vector3 Min(const Vector3& v1, const Vector3& v2);
+		static Vector3 Project(const Vector3& v1, const Vector3& v2)
+		{
+			return (v2 * (Dot(v1, v2) / Dot(v2, v2)));
+		}
+
+		static Vector3 Reject(const Vector3& v1, const Vector3& v2)
+		{
+			return (v1 - v2 * (Dot(v1, v2) / Dot(v2, v2)));
+		}
+
+		static Vector3 Reflect(const Vector3& v1, const Vector3& v2)
+		{
+			return v1 - v2 * (2.f * Dot(v1, v2));
+		}
+
+		static Vector3 Max(const Vector3& v1, const Vector3& v2)
+		{
+			return { std::max(v1.x, v2.x), std::max(v1.y, v2.y), std::max(v1.z, v2.z) };
+		}
+
+		static Vector3 Min(const Vector3& v1, const Vector3& v2)
+		{
+			return { std::min(v1.x, v2.x), std::min(v1.y, v2.y), std::min(v1.z, v2.z) };
+		}
 
 		static Vector3 Lico(float f1, const Vector3& v1, float f2, const Vector3& v2, float f3, const Vector3& v3);
 
@@ -35,18 +90,75 @@ namespace dae
 		Vector4 ToVector4() const;
 
 		//Member Operators
-		Vector3 operator*(float scale) const;
-		Vector3 operator/(float scale) const;
-		Vector3 operator+(const Vector3& v) const;
-		Vector3 operator-(const Vector3& v) const;
-		Vector3 operator-() const;
-		//Vector3& operator-();
-		Vector3& operator+=(const Vector3& v);
-		Vector3& operator-=(const Vector3& v);
-		Vector3& operator/=(float scale);
-		Vector3& operator*=(float scale);
-		float& operator[](int index);
-		float operator[](int index) const;
+		Vector3 operator*(float scale) const
+		{
+			return { x * scale, y * scale, z * scale };
+		}
+
+		Vector3 operator/(float scale) const
+		{
+			return { x / scale, y / scale, z / scale };
+		}
+
+		Vector3 operator+(const Vector3& v) const
+		{
+			return { x + v.x, y + v.y, z + v.z };
+		}
+
+		Vector3 operator-(const Vector3& v) const
+		{
+			return { x - v.x, y - v.y, z - v.z };
+		}
+
+		Vector3 operator-() const
+		{
+			return { -x, -y, -z };
+		}
+
+		Vector3& operator+=(const Vector3& v)
+		{
+			x += v.x;
+			y += v.y;
+			z += v.z;
+			return *this;
+		}
+
+		Vector3& operator-=(const Vector3& v)
+		{
+			x -= v.x;
+			y -= v.y;
+			z -= v.z;
+			return *this;
+		}
+
+		Vector3& operator/=(float scale)
+		{
+			x /= scale;
+			y /= scale;
+			z /= scale;
+			return *this;
+		}
+
+		Vector3& operator*=(float scale)
+		{
+			x *= scale;
+			y *= scale;
+			z *= scale;
+			return *this;
+		}
+
+		//x, y and z are consecutive, so the component is a plain offset instead of a branch chain
+		float& operator[](int index)
+		{
+			assert(index <= 2 && index >= 0);
+			return (&x)[index];
+		}
+
+		float operator[](int index) const
+		{
+			assert(index <= 2 && index >= 0);
+			return (&x)[index];
+		}
 
 		static const Vector3 UnitX;
 		static const Vector3 UnitY;
@@ -6,11 +6,16 @@
 
 //Standard includes
 #include <iostream>
+#include <string>
+#include <vector>
 
 //Project includes
+#include "Benchmark.h"
+#include "FramePipeline.h"
 #include "Timer.h"
 #include "Renderer.h"
 #include "Scene.h"
+#include "ThreadPool.h"
 
 using namespace dae;
 
@@ -20,11 +25,113 @@ void ShutDown(SDL_Window* pWindow)
 	SDL_Quit();
 }
 
+//Render pool options anywhere on the command line: --threads N, --affinity none|compact|scatter, --no-smt
+ThreadPool::Configuration ParseThreadOptions(int argc, char* args[])
+{
+	ThreadPool::Configuration configuration{};
+	for (int i{ 1 }; i < argc; ++i)
+	{
+		const std::string option{ args[i] };
+		if (option == "--threads" && i + 1 < argc)
+		{
+			configuration.threadCount = static_cast<uint32_t>(std::stoul(args[++i]));
+		}
+		else if (option == "--affinity" && i + 1 < argc)
+		{
+			const std::string affinity{ args[++i] };
+			if (affinity == "compact")
+				configuration.affinity = ThreadPool::Affinity::Compact;
+			else if (affinity == "scatter")
+				configuration.affinity = ThreadPool::Affinity::Scatter;
+			else
+				configuration.affinity = ThreadPool::Affinity::None;
+		}
+		else if (option == "--no-smt")
+		{
+			configuration.useSMT = false;
+		}
+	}
+	return configuration;
+}
+
 int main(int argc, char* args[])
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	const ThreadPool::Configuration threads{ ParseThreadOptions(argc, args) };
+
+	//Command line benchmarks, these run without a window
+	//RayTracer.exe --benchmark-bvh [file.obj ...]
+	if (argc > 1 && std::string(args[1]) == "--benchmark-bvh")
+	{
+		std::vector<std::string> objFiles{ args + 2, args + argc };
+		if (objFiles.empty())
+			objFiles.emplace_back("Resources/lowpoly_bunny.obj");
+
+		Benchmark::BVHTraversal(objFiles);
+		return 0;
+	}
+
+	//RayTracer.exe --benchmark-math [frameCount]
+	if (argc > 1 && std::string(args[1]) == "--benchmark-math")
+	{
+		Benchmark::MathLayer(argc > 2 ? static_cast<uint32_t>(std::stoul(args[2])) : 20);
+		return 0;
+	}
+
+	//RayTracer.exe --benchmark-render [frameCount]
+	if (argc > 1 && std::string(args[1]) == "--benchmark-render")
+	{
+		Benchmark::RenderPaths(argc > 2 ? static_cast<uint32_t>(std::stoul(args[2])) : 20);
+		return 0;
+	}
+
+	//RayTracer.exe --benchmark-brdf-tables
+	if (argc > 1 && std::string(args[1]) == "--benchmark-brdf-tables")
+	{
+		Benchmark::BRDFTables();
+		return 0;
+	}
+
+	//RayTracer.exe --benchmark-tiles [frameCount]
+	if (argc > 1 && std::string(args[1]) == "--benchmark-tiles")
+	{
+		Benchmark::TileScheduler(argc > 2 ? static_cast<uint32_t>(std::stoul(args[2])) : 20);
+		return 0;
+	}
+
+	//RayTracer.exe --benchmark-pipeline [frameCount]
+	if (argc > 1 && std::string(args[1]) == "--benchmark-pipeline")
+	{
+		Benchmark::PipelineModes(argc > 2 ? static_cast<uint32_t>(std::stoul(args[2])) : 50);
+		return 0;
+	}
+
+	//RayTracer.exe --benchmark-progressive [budgetMilliseconds]
+	if (argc > 1 && std::string(args[1]) == "--benchmark-progressive")
+	{
+		Benchmark::ProgressiveRefinement(argc > 2 ? std::stof(args[2]) : 16.f);
+		return 0;
+	}
+
+	//RayTracer.exe --benchmark-dynamic-resolution [frameCount]
+	if (argc > 1 && std::string(args[1]) == "--benchmark-dynamic-resolution")
+	{
+		Benchmark::DynamicResolution(argc > 2 ? static_cast<uint32_t>(std::stoul(args[2])) : 40);
+		return 0;
+	}
+
+	//RayTracer.exe --benchmark-scaling [--threads N] [--affinity none|compact|scatter] [--no-smt]
+	if (argc > 1 && std::string(args[1]) == "--benchmark-scaling")
+	{
+		Benchmark::ThreadScaling(threads);
+		return 0;
+	}
+
+	//RayTracer.exe --benchmark-spheres [sphereCount]
+	if (argc > 1 && std::string(args[1]) == "--benchmark-spheres")
+	{
+		Benchmark::SphereIntersection(argc > 2 ? static_cast<uint32_t>(std::stoul(args[2])) : 4096);
+		return 0;
+	}
 
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
@@ -43,15 +150,24 @@ int main(int argc, char* args[])
 
 	//Initialize "framework"
 	const auto pTimer = new Timer();
-	const auto pRenderer = new Renderer(pWindow);
+	const auto pRenderer = new Renderer(pWindow, threads);
+	std::cout << "RENDER THREADS: " << pRenderer->GetThreadCount() << std::endl;
 
-	//const auto pScene = new Scene_W1();
-	//const auto pScene = new Scene_W2();
-	//const auto pScene = new Scene_W3();
+	//using SceneType = Scene_W1;
+	//using SceneType = Scene_W2;
+	//using SceneType = Scene_W3;
 	
-	const auto pScene = new Scene_W4_ReferenceScene();
-	//const auto pScene = new Scene_W4_TestScene();
+	using SceneType = Scene_W4_ReferenceScene;
+	//using SceneType = Scene_W4_TestScene;
+	//using SceneType = Scene_SphereStress;
+
+	//The frame pipeline updates the next frame on the second instance while the first one is traced
+	const auto pScene = new SceneType();
+	const auto pSnapshot = new SceneType();
 	pScene->Initialize();
+	pSnapshot->Initialize();
+
+	const auto pPipeline = new FramePipeline(pRenderer, pScene, pSnapshot);
 
 	//Start loop
 	pTimer->Start();
@@ -80,44 +196,75 @@ int main(int argc, char* args[])
 					takeScreenshot = true;
 				break;
 			case SDL_KEYDOWN:
+				//The renderer settings only change between frames, every key that changes one flushes the pipeline first.
+				//Other keys, like the camera movement, keep the stages overlapping
 				switch (e.key.keysym.sym) 
 				{
 				case SDLK_F2:
 					// Toggle shadows when F2 is pressed
+					pPipeline->Flush();
 					pRenderer->ToggleShadows();
 					break;
 				case SDLK_F3:
 					// Cycle through lighting modes when F3 is pressed
+					pPipeline->Flush();
 					pRenderer->CycleLightingMode();
 					break;
+				case SDLK_F4:
+					// Switch between the per pixel and the wavefront render path when F4 is pressed
+					pPipeline->Flush();
+					pRenderer->ToggleWavefront();
+					break;
 				case SDLK_F6:
 					// Cycle through lighting modes when F3 is pressed
 					pTimer->StartBenchmark();
 					break;
+				case SDLK_F7:
+					// Switch the frame pipeline between latency and throughput when F7 is pressed
+					pPipeline->ToggleMode();
+					break;
+				case SDLK_F8:
+					// Toggle progressive rendering when F8 is pressed
+					pPipeline->Flush();
+					pRenderer->ToggleProgressive();
+					break;
+				case SDLK_F9:
+					// Toggle dynamic resolution when F9 is pressed
+					pPipeline->Flush();
+					pRenderer->ToggleDynamicResolution();
+					break;
 				}
 			}
 		}
 
-		//--------- Update ---------
-		pScene->Update(pTimer);
-
-		//--------- Render ---------
-		pRenderer->Render(pScene);
-		//pRenderer->RenderPixel(pScene);
-		
+		//--------- Update + Render ---------
+		pPipeline->Frame(pTimer);
 
 		//--------- Timer ---------
 		pTimer->Update();
+		pRenderer->ReportFrameTime(pTimer->GetElapsed());
 		printTimer += pTimer->GetElapsed();
 		if (printTimer >= 1.f)
 		{
 			printTimer = 0.f;
 			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+
+			const FramePipeline::Timings timings = pPipeline->GetTimings();
+			std::cout << "   update " << timings.update << " ms, trace " << timings.trace << " ms, resolve " << timings.resolve
+				<< " ms, present " << timings.present << " ms, latency " << timings.latency << " ms" << std::endl;
+
+			if (pRenderer->IsDynamicResolutionEnabled())
+			{
+				//The render size changes at the start of a trace
+				pPipeline->Flush();
+				std::cout << "   render " << pRenderer->GetRenderWidth() << "x" << pRenderer->GetRenderHeight() << std::endl;
+			}
 		}
 
 		//Save screenshot after full render
 		if (takeScreenshot)
 		{
+			pPipeline->Flush();
 			if (!pRenderer->SaveBufferToImage())
 				std::cout << "Screenshot saved!" << std::endl;
 			else
@@ -128,6 +275,8 @@ int main(int argc, char* args[])
 	pTimer->Stop();
 
 	//Shutdown "framework"
+	delete pPipeline;
+	delete pSnapshot;
 	delete pScene;
 	delete pRenderer;
 	delete pTimer;